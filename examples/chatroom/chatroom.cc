@@ -2,9 +2,8 @@
 #include <string>
 #include <format>
 #include <chrono>
-#include <queue>
+#include <vector>
 #include <memory>
-#include <sstream>
 
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -12,6 +11,7 @@
 #include <string.h>
 #endif
 #include <arpa/inet.h>
+#include <fcntl.h>
 
 #include <noevent.h>
 
@@ -19,8 +19,6 @@ using namespace noevent;
 using namespace std::chrono_literals;
 
 
-using MsgQueue = std::queue<std::shared_ptr<std::string>>;
-
 struct UserData
 {
     UserData(std::string ip, std::uint16_t port)
@@ -28,8 +26,6 @@ struct UserData
 
     std::string ip_;
     std::uint16_t port_;
-    MsgQueue msg_queue_;
-    bool is_quit_ { false };
 };
 
 
@@ -38,7 +34,6 @@ std::unordered_map<int, std::shared_ptr<UserData>> accepted_users;
 
 void ServerReadCallback(int fd, Event::Type type, std::shared_ptr<void> data);
 void UserReadCallback(int fd, Event::Type type, std::shared_ptr<void> data);
-void UserWriteCallback(int fd, Event::Type type, std::shared_ptr<void> data);
 
 
 int main()
@@ -55,15 +50,13 @@ int main()
     EV_HUB.CreateEmpty(server_sock, [](int, Event::Type, std::shared_ptr<void>) {})
         .OnRead(ServerReadCallback).Ready();
 
-    while (true) {
-        EV_HUB.LoopOnce();
-    }
+    while (EV_HUB.LoopOnce() == 0) {}
     close(server_sock);
 
     return 0;
 }
 
-void ServerReadCallback(int fd, Event::Type type, std::shared_ptr<void> data)
+void ServerReadCallback(int fd, Event::Type, std::shared_ptr<void>)
 {
     sockaddr_in user_addr;
     socklen_t user_addr_len = sizeof(user_addr);
@@ -72,63 +65,42 @@ void ServerReadCallback(int fd, Event::Type type, std::shared_ptr<void> data)
     std::uint16_t user_port = ntohs(user_addr.sin_port);
     std::cout << std::format("Accept user with {}:{}\n", user_ip, user_port);
 
+    // Broadcast messages are flushed by the hub, which should never block the loop.
+    fcntl(user_sock, F_SETFL, fcntl(user_sock, F_GETFL) | O_NONBLOCK);
     auto user = std::make_shared<UserData>(std::move(user_ip), user_port);
     accepted_users[user_sock] = user;
     EV_HUB.CreateEmpty(user_sock, [](int, Event::Type, std::shared_ptr<void>) {})
-        .WithData(user).OnRead(UserReadCallback).OnWrite(UserWriteCallback).Ready();
+        .WithData(user).OnRead(UserReadCallback).Ready();
 
     EV_HUB.SetCurrent(fd).OnRead(ServerReadCallback).Ready();
 }
 
-void UserReadCallback(int fd, Event::Type type, std::shared_ptr<void> data)
+void UserReadCallback(int fd, Event::Type, std::shared_ptr<void> data)
 {
     auto user_data = std::static_pointer_cast<UserData>(data);
-    if (user_data->is_quit_) {
-        return;
-    }
 
     char buffer[kBufferSize]{'\0'};
     int msg_len = read(fd, buffer, kBufferSize - 1);
     if (msg_len <= 0) {
         std::cout << std::format("User [{}:{}] quit.\n", user_data->ip_, user_data->port_);
         accepted_users.erase(fd);  // no longer new messages are going to be received.
-        user_data->is_quit_ = true;
+        EV_HUB.SetCurrent(fd).Destroy();
+        close(fd);
         return;
     }
     buffer[msg_len] = '\0';
 
-    auto user_msg = std::make_shared<std::string>(
+    // Only one copy of the message is shared by all users.
+    auto user_msg = std::make_shared<const std::string>(
         std::format("[{}:{}] - ", user_data->ip_, user_data->port_) + buffer);
+    std::vector<int> user_fds;
+    user_fds.reserve(accepted_users.size());
     for (const auto& user : accepted_users) {
-        user.second->msg_queue_.push(user_msg);
-    }
-    std::cout << std::format("Meesage: \n\t{} from [{}:{}] has been broadcast.\n",
-        buffer, user_data->ip_, user_data->port_);
-
-    EV_HUB.SetCurrent(fd).OnRead(UserReadCallback).OnWrite(UserWriteCallback).Ready();
-}
-
-void UserWriteCallback(int fd, Event::Type type, std::shared_ptr<void> data)
-{
-    auto user_data = std::static_pointer_cast<UserData>(data);
-    if (user_data->is_quit_) {
-        EV_HUB.SetCurrent(fd).Destroy();
-        return;
-    }
-
-    auto msg_count = user_data->msg_queue_.size();
-    std::stringstream ss;
-    while (!user_data->msg_queue_.empty()) {
-        ss << *(user_data->msg_queue_.front());
-        user_data->msg_queue_.pop();
-    }
-
-    std::string messages = ss.str();
-    if (!messages.empty()) {
-        write(fd, messages.data(), messages.length());
-        std::cout << std::format("Write {} messages back to [{}:{}]\n",
-            msg_count, user_data->ip_, user_data->port_);
+        user_fds.push_back(user.first);
     }
+    EV_HUB.Broadcast(user_msg, user_fds);
+    std::cout << std::format("Meesage: \n\t{} from [{}:{}] has been broadcast to {} users.\n",
+        buffer, user_data->ip_, user_data->port_, user_fds.size());
 
-    EV_HUB.SetCurrent(fd).OnRead(UserReadCallback).OnWrite(UserWriteCallback).Ready();
+    EV_HUB.SetCurrent(fd).OnRead(UserReadCallback).Ready();
 }
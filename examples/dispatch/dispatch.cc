@@ -0,0 +1,158 @@
+#include <iostream>
+#include <string_view>
+#include <format>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <charconv>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <noevent.h>
+
+using namespace noevent;
+
+// Measures the cost of dispatching an event with the built-in backend, which is called
+// directly, and with the same backend set by `EventHub::SetBackend()`, which is called
+// virtually, e.g.
+//   noevent_dispatch --fds=100 --iterations=20000
+// Every fd is kept readable and re-armed in its read callback, so each iteration
+// re-registers, polls and dispatches all of them. The in-memory backend is measured
+// last, which leaves the overhead of the hub itself without syscalls.
+
+
+struct Options
+{
+    int fds { 100 };
+    int iterations { 20000 };
+};
+
+Options options;
+std::vector<int> fds;
+std::uint64_t dispatch_count { 0 };
+int armed_count { 0 };
+bool is_stopping { false };
+internal::MemoryEventOperation* memory_ev_op { nullptr };
+
+bool ParseOptions(int argc, char* argv[]);
+void Arm(int fd);
+void Run(std::string_view name);
+
+
+int main(int argc, char* argv[])
+{
+    if (!ParseOptions(argc, argv)) {
+        std::cout << "Usage: noevent_dispatch [--fds=100] [--iterations=20000]\n";
+        return 1;
+    }
+
+    // One end of each pair is left unread, so the other end stays readable.
+    for (int i = 0; i < options.fds; ++i) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+            std::cout << "Failed to create socket pairs.\n";
+            return 1;
+        }
+        write(pair[1], "x", 1);
+        fds.push_back(pair[0]);
+        fds.push_back(pair[1]);
+    }
+
+    Run("static");
+    EV_HUB.SetBackend(std::make_unique<
+#ifdef __APPLE__
+        internal::KQueue
+#elif defined(__linux__)
+        internal::Epoll
+#endif
+        >());
+    Run("virtual");
+    auto memory = std::make_unique<internal::MemoryEventOperation>();
+    memory_ev_op = memory.get();
+    EV_HUB.SetBackend(std::move(memory));
+    Run("memory");
+
+    for (int fd : fds) {
+        close(fd);
+    }
+    return 0;
+}
+
+bool ParseOptions(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg { argv[i] };
+        auto pos = arg.find('=');
+        if (!arg.starts_with("--") || pos == std::string_view::npos) {
+            return false;
+        }
+        auto key = arg.substr(2, pos - 2);
+        auto value = arg.substr(pos + 1);
+        auto parse_int = [value](auto& field) {
+            return std::from_chars(value.data(), value.data() + value.size(), field).ec == std::errc {};
+        };
+        bool is_valid = true;
+        if (key == "fds") {
+            is_valid = parse_int(options.fds) && options.fds > 0;
+        } else if (key == "iterations") {
+            is_valid = parse_int(options.iterations) && options.iterations > 0;
+        } else {
+            is_valid = false;
+        }
+        if (!is_valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Arm(int fd)
+{
+    EV_HUB.SetCurrent(fd).OnRead([](int fd, Event::Type, std::shared_ptr<void>) {
+        dispatch_count++;
+        if (is_stopping) {
+            // Events in ready cannot be destroyed, so they are destroyed by themselves.
+            EV_HUB.SetCurrent(fd).Destroy();
+            armed_count--;
+            return;
+        }
+        if (memory_ev_op != nullptr) {
+            // Readiness in memory is consumed once it is delivered.
+            memory_ev_op->Inject(fd, internal::MemoryEventOperation::Readiness::kRead);
+        }
+        Arm(fd);
+    }).Ready();
+}
+
+void Run(std::string_view name)
+{
+    for (int i = 0; i < options.fds; ++i) {
+        int fd = fds[2 * i];
+        EV_HUB.CreateEmpty(fd, [](int, Event::Type, std::shared_ptr<void>) {});
+        if (memory_ev_op != nullptr) {
+            memory_ev_op->Inject(fd, internal::MemoryEventOperation::Readiness::kRead);
+        }
+        Arm(fd);
+        armed_count++;
+    }
+
+    // The first iteration registers all fds, which is not measured.
+    EV_HUB.LoopOnce(false);
+    dispatch_count = 0;
+    auto start_stamp = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.iterations; ++i) {
+        EV_HUB.LoopOnce(false);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start_stamp;
+
+    std::cout << std::format("{:>8}: {} events dispatched, {:.1f} ns/event\n", name, dispatch_count,
+        dispatch_count == 0 ? 0.0 :
+            static_cast<double>(std::chrono::nanoseconds(elapsed).count()) / dispatch_count);
+
+    is_stopping = true;
+    while (armed_count != 0) {
+        EV_HUB.LoopOnce(false);
+    }
+    is_stopping = false;
+}
@@ -12,17 +12,20 @@
 #include <string.h>
 #endif
 #include <arpa/inet.h>
+#include <fcntl.h>
 
 #include <noevent.h>
+#include <noevent_codec.h>
 
 using namespace noevent;
 using namespace std::chrono_literals;
 
-constexpr int kBufferSize { 512 };
+constexpr int kMaxLineSize { 512 };
+const auto kLineCodec { std::make_shared<const codec::DelimiterCodec>("\n") };
 
 
-void ClientReadCallback(int fd, Event::Type type, std::shared_ptr<void> data);
-void ClientWriteCallback(int fd, Event::Type type, std::shared_ptr<void> data);
+void ClientFrameCallback(int fd, std::string_view line);
+void ClientCloseCallback(int fd, int reason);
 void ServerReadCallback(int fd, Event::Type type, std::shared_ptr<void> data);
 
 struct ClientData
@@ -32,7 +35,6 @@ struct ClientData
 
     std::string ip_;
     std::uint16_t port_;
-    std::string msg_;
 };
 
 
@@ -50,46 +52,36 @@ int main()
     EV_HUB.CreateEmpty(server_sock, [](int, Event::Type, std::shared_ptr<void>) {})
         .OnRead(ServerReadCallback).Ready();
 
-    while (true) {
-        EV_HUB.LoopOnce();
-    }
+    while (EV_HUB.LoopOnce() == 0) {}
     close(server_sock);
 
     return 0;
 }
 
 
-void ClientReadCallback(int fd, Event::Type type, std::shared_ptr<void> data)
+void ClientFrameCallback(int fd, std::string_view line)
 {
-    auto client_data = std::static_pointer_cast<ClientData>(data);
-    char buffer[kBufferSize]{'\0'};
-    int msg_len = read(fd, buffer, kBufferSize - 1);
-    if (msg_len <= 0) {
-        std::cout << std::format("Connection was closed by client [{}:{}]\n",
-            client_data->ip_, client_data->port_);
-        EV_HUB.SetCurrent(fd).Destroy();
-        return;
+    // Several lines may be delivered by one read, and each of them is echoed.
+    auto client_data = std::static_pointer_cast<ClientData>(EV_HUB.GetData(fd));
+    if (line.ends_with('\r')) {
+        line.remove_suffix(1);
     }
-    buffer[msg_len] = '\0';
-    client_data->msg_ = buffer;
     std::cout << std::format("Received message \"{}\" from client [{}:{}]\n",
-        client_data->msg_.substr(0, msg_len - 2), client_data->ip_, client_data->port_);
-    
-    EV_HUB.SetCurrent(fd).OnWrite(ClientWriteCallback).Ready();
+        line, client_data->ip_, client_data->port_);
+
+    EV_HUB.Send(fd, kLineCodec->Encode(line));
 }
 
-void ClientWriteCallback(int fd, Event::Type type, std::shared_ptr<void> data)
+void ClientCloseCallback(int fd, int)
 {
-    auto client_data = std::static_pointer_cast<ClientData>(data);
-    write(fd, client_data->msg_.data(), client_data->msg_.length());
-    std::cout << std::format("Write message \"{}\" back to client [{}:{}]\n",
-        client_data->msg_.substr(0, client_data->msg_.length() - 2), client_data->ip_, client_data->port_);
-    client_data->msg_.clear();
-
-    EV_HUB.SetCurrent(fd).OnRead(ClientReadCallback).Ready(10s);
+    auto client_data = std::static_pointer_cast<ClientData>(EV_HUB.GetData(fd));
+    std::cout << std::format("Connection was closed by client [{}:{}]\n",
+        client_data->ip_, client_data->port_);
+    EV_HUB.SetCurrent(fd).Destroy();
+    close(fd);
 }
 
-void ServerReadCallback(int fd, Event::Type type, std::shared_ptr<void> data)
+void ServerReadCallback(int fd, Event::Type, std::shared_ptr<void>)
 {
     sockaddr_in client_addr;
     socklen_t client_addr_len = sizeof(client_addr);
@@ -97,6 +89,7 @@ void ServerReadCallback(int fd, Event::Type type, std::shared_ptr<void> data)
     std::string client_ip{ inet_ntoa(client_addr.sin_addr) };
     std::uint16_t client_port = ntohs(client_addr.sin_port);
     std::cout << std::format("Accept client with {}:{}\n", client_ip, client_port);
+    fcntl(client_sock, F_SETFL, fcntl(client_sock, F_GETFL) | O_NONBLOCK);
 
     EV_HUB.CreateEmpty(client_sock, [](int fd, Event::Type type, std::shared_ptr<void> data) {
             auto client_data = std::static_pointer_cast<ClientData>(data);
@@ -108,8 +101,9 @@ void ServerReadCallback(int fd, Event::Type type, std::shared_ptr<void> data)
                 return;
             }
         })
-        .WithData(std::make_shared<ClientData>(std::move(client_ip), client_port))
-        .OnRead(ClientReadCallback).Ready(10s);
+        .WithData(std::make_shared<ClientData>(std::move(client_ip), client_port));
+    codec::Attach(client_sock, std::make_shared<codec::FrameReader>(kLineCodec, kMaxLineSize),
+        ClientFrameCallback, ClientCloseCallback, 10s);
 
     EV_HUB.SetCurrent(fd).OnRead(ServerReadCallback).Ready();
 }
@@ -0,0 +1,33 @@
+#include <iostream>
+#include <string>
+#include <format>
+
+#include <signal.h>
+
+#include <noevent.h>
+#include <noevent_http.h>
+
+using namespace noevent;
+using namespace std::chrono_literals;
+
+
+int main()
+{
+    // The peer may close the connection before responses are flushed.
+    signal(SIGPIPE, SIG_IGN);
+
+    http::Server server([](const http::Request& request, http::Response& response) {
+        if (request.target == "/echo") {
+            response.body = request.body;
+        } else {
+            response.body = std::format("Hello, {} {}!\n", request.method, request.target);
+        }
+        response.headers.emplace_back("Content-Type", "text/plain");
+    });
+    server.SetIdleTimeout(10s);
+    server.Listen(10086);
+
+    while (EV_HUB.LoopOnce() == 0) {}
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <format>
+#include <vector>
+#include <memory>
+#include <charconv>
+
+#include <cstddef>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <noevent.h>
+
+using namespace noevent;
+
+// Measures the resident memory per idle connection, e.g.
+//   noevent_idle --connections=10000 --mode=auto
+// Every connection is a socket pair, whose kernel buffers are not counted. In "owned"
+// mode each connection reads into a receive buffer of its own, as a codec does, while
+// in "auto" mode the hub reads into a pooled buffer by `AutoRead()`. Memory is taken
+// once all events are armed, and again after every connection has read one message
+// and become idle, so the latter shows what a buffer left behind costs.
+
+
+struct Options
+{
+    int connections { 10000 };
+    std::string mode { "auto" };  // "auto" or "owned"
+    int size { 64 };              // bytes per message
+};
+
+struct Connection
+{
+    std::unique_ptr<char[]> buffer_ { nullptr };
+};
+
+// As large as the largest class of the pool.
+constexpr std::size_t kOwnedBufferSize { utils::BufferPool::kMinClassSize << (utils::BufferPool::kClassCount - 1) };
+
+Options options;
+std::vector<int> peer_fds;
+int read_count { 0 };
+
+bool ParseOptions(int argc, char* argv[]);
+std::size_t ResidentBytes();
+void Arm(int fd);
+void Report(std::string_view stage, std::size_t base_bytes);
+
+
+int main(int argc, char* argv[])
+{
+    if (!ParseOptions(argc, argv)) {
+        std::cout << "Usage: noevent_idle [--connections=10000] [--mode=auto|owned] [--size=64]\n";
+        return 1;
+    }
+
+    // Two fds are taken by each connection, and a few are left for reading the memory.
+    rlimit fd_limit;
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) == 0) {
+        fd_limit.rlim_cur = fd_limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &fd_limit);
+        if (fd_limit.rlim_cur != RLIM_INFINITY && fd_limit.rlim_cur / 2 < static_cast<rlim_t>(options.connections) + 8) {
+            options.connections = fd_limit.rlim_cur > 16 ? fd_limit.rlim_cur / 2 - 8 : 0;
+            std::cout << std::format("Connections are limited to {} by the limit of fds.\n", options.connections);
+        }
+    }
+
+    // The hub is created first, which takes an fd and is not per connection.
+    EV_HUB.EventsCount();
+    std::vector<int> fds;
+    fds.reserve(options.connections);
+    peer_fds.reserve(options.connections);
+    for (int i = 0; i < options.connections; ++i) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+            std::cout << "Failed to create socket pairs.\n";
+            return 1;
+        }
+        fcntl(pair[0], F_SETFL, fcntl(pair[0], F_GETFL) | O_NONBLOCK);
+        fds.push_back(pair[0]);
+        peer_fds.push_back(pair[1]);
+    }
+    std::size_t base_bytes = ResidentBytes();
+
+    for (int fd : fds) {
+        auto conn = std::make_shared<Connection>();
+        if (options.mode == "owned") {
+            // Zero-filled, since pages never written are not resident.
+            conn->buffer_.reset(new char[kOwnedBufferSize]());
+        }
+        EV_HUB.CreateEmpty(fd, [](int, Event::Type, std::shared_ptr<void>) {}).WithData(conn);
+        if (options.mode == "auto") {
+            EV_HUB.AutoRead();
+        }
+        Arm(fd);
+    }
+    EV_HUB.LoopOnce(false);
+    Report("armed", base_bytes);
+
+    std::string message(options.size, 'x');
+    for (int fd : peer_fds) {
+        write(fd, message.data(), message.size());
+    }
+    while (read_count < options.connections) {
+        EV_HUB.LoopOnce();
+    }
+    // Re-armed events are registered again.
+    EV_HUB.LoopOnce(false);
+    Report("idle after a read", base_bytes);
+
+    // Registered events are locked, and all fds are closed by exiting.
+    return 0;
+}
+
+bool ParseOptions(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg { argv[i] };
+        auto pos = arg.find('=');
+        if (!arg.starts_with("--") || pos == std::string_view::npos) {
+            return false;
+        }
+        auto key = arg.substr(2, pos - 2);
+        auto value = arg.substr(pos + 1);
+        auto parse_int = [value](auto& field) {
+            return std::from_chars(value.data(), value.data() + value.size(), field).ec == std::errc {};
+        };
+        bool is_valid = true;
+        if (key == "connections") {
+            is_valid = parse_int(options.connections) && options.connections > 0;
+        } else if (key == "mode") {
+            options.mode = value;
+            is_valid = value == "auto" || value == "owned";
+        } else if (key == "size") {
+            is_valid = parse_int(options.size) && options.size > 0;
+        } else {
+            is_valid = false;
+        }
+        if (!is_valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::size_t ResidentBytes()
+{
+#ifdef __linux__
+    // The second field is the resident set in pages.
+    std::ifstream statm { "/proc/self/statm" };
+    std::size_t size_pages = 0;
+    std::size_t resident_pages = 0;
+    statm >> size_pages >> resident_pages;
+    return resident_pages * sysconf(_SC_PAGESIZE);
+#else
+    // Only the peak is known elsewhere, which is still fine since memory only grows here.
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#endif
+}
+
+void Arm(int fd)
+{
+    EV_HUB.SetCurrent(fd).OnRead([](int fd, Event::Type, std::shared_ptr<void> data) {
+        if (options.mode == "owned") {
+            auto conn = std::static_pointer_cast<Connection>(data);
+            read(fd, conn->buffer_.get(), kOwnedBufferSize);
+        }
+        // Bytes of an auto-read event are dropped along with its buffer.
+        read_count++;
+        Arm(fd);
+    }).Ready();
+}
+
+void Report(std::string_view stage, std::size_t base_bytes)
+{
+    std::size_t bytes = ResidentBytes();
+    std::size_t delta = bytes > base_bytes ? bytes - base_bytes : 0;
+    std::cout << std::format("{:>18}: {} connections, {:.1f} KB resident, {:.2f} KB per connection\n",
+        stage, options.connections, delta / 1024.0, delta / 1024.0 / options.connections);
+}
@@ -0,0 +1,325 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <format>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <charconv>
+#include <algorithm>
+#include <bit>
+
+#include <cstdint>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <noevent.h>
+#include <noevent_codec.h>
+#include <noevent_client.h>
+
+using namespace noevent;
+using namespace std::chrono_literals;
+
+// Drives `examples/echo`, `examples/chatroom` or `examples/http` over loopback, e.g.
+//   noevent_loadgen --scenario=echo --connections=1000 --rate=50000 --duration=10
+// A message is a line of "@<connection>:<nanoseconds>:" padded to `--size` bytes, and
+// its latency is measured from when it was intended to be sent, so a slow server is
+// not hidden by a slow sender in open-loop mode. The http scenario posts the line to
+// "/echo", so comparing it with the echo scenario shows the overhead of the module.
+
+
+struct Options
+{
+    std::string scenario { "echo" };  // "echo", "broadcast" or "http"
+    std::string ip { "127.0.0.1" };
+    std::uint16_t port { 10086 };
+    int connections { 100 };
+    int duration { 10 };              // seconds
+    int rate { 0 };                   // messages per second in total, 0 for closed-loop
+    int size { 64 };                  // bytes per message, including the newline
+};
+
+// Latencies are kept in log-linear buckets as HdrHistogram does, and every bucket is
+// narrower than 1/128 of its values, so percentiles are precise to about 0.8%.
+class Histogram
+{
+public:
+    void Record(std::uint64_t value)
+    {
+        counts_[Index(value)]++;
+        total_count_++;
+        max_ = std::max(max_, value);
+    }
+
+    // Returns the highest value which is equivalent to the percentile.
+    std::uint64_t Percentile(double percentile) const
+    {
+        auto wanted = static_cast<std::uint64_t>(percentile / 100 * total_count_ + 0.5);
+        std::uint64_t count = 0;
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            count += counts_[i];
+            if (count >= std::max<std::uint64_t>(wanted, 1)) {
+                return std::min(HighestOf(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    std::uint64_t TotalCount() const { return total_count_; }
+    std::uint64_t Max() const { return max_; }
+
+private:
+    static constexpr int kSubBucketBits { 8 };
+    static constexpr std::uint64_t kSubBucketCount { 1 << kSubBucketBits };
+    static constexpr std::uint64_t kHalfCount { kSubBucketCount / 2 };
+
+    static std::size_t Index(std::uint64_t value)
+    {
+        if (value < kSubBucketCount) {
+            return value;
+        }
+        int shift = std::bit_width(value) - kSubBucketBits;
+        return kSubBucketCount + (shift - 1) * kHalfCount + ((value >> shift) - kHalfCount);
+    }
+
+    static std::uint64_t HighestOf(std::size_t index)
+    {
+        if (index < kSubBucketCount) {
+            return index;
+        }
+        std::uint64_t shift = (index - kSubBucketCount) / kHalfCount + 1;
+        std::uint64_t sub_bucket = (index - kSubBucketCount) % kHalfCount + kHalfCount;
+        return ((sub_bucket + 1) << shift) - 1;
+    }
+
+    std::vector<std::uint64_t> counts_ = std::vector<std::uint64_t>(kSubBucketCount + 64 * kHalfCount);
+    std::uint64_t total_count_ { 0 };
+    std::uint64_t max_ { 0 };
+};
+
+struct Connection
+{
+    int id_;
+    int fd_ { -1 };
+};
+
+
+const auto kLineCodec { std::make_shared<const codec::DelimiterCodec>("\n") };
+Options options;
+Histogram latencies;
+std::vector<std::shared_ptr<Connection>> connections;
+std::vector<std::shared_ptr<Connection>> connected;
+std::uint64_t sent_count { 0 };
+std::uint64_t error_count { 0 };
+bool is_measuring { false };
+
+std::uint64_t NowNanoseconds();
+bool ParseOptions(int argc, char* argv[]);
+void SendMessage(const Connection& conn, std::uint64_t intended_stamp);
+void OnConnected(std::shared_ptr<Connection> conn, int fd, int reason);
+void OnFrame(std::shared_ptr<Connection> conn, std::string_view line);
+void OnClose(int fd, int reason);
+void Report(std::chrono::nanoseconds elapsed);
+
+
+int main(int argc, char* argv[])
+{
+    if (!ParseOptions(argc, argv)) {
+        std::cout << "Usage: noevent_loadgen [--scenario=echo|broadcast|http] [--ip=127.0.0.1] [--port=10086]\n"
+            "    [--connections=100] [--duration=10] [--rate=0 (closed-loop)] [--size=64]\n";
+        return 1;
+    }
+
+    // Thousands of connections are far beyond the default limit of fds.
+    rlimit fd_limit;
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) == 0) {
+        fd_limit.rlim_cur = fd_limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &fd_limit);
+    }
+
+    for (int i = 0; i < options.connections; ++i) {
+        auto conn = std::make_shared<Connection>(Connection { i });
+        connections.push_back(conn);
+        client::Connect(options.ip, options.port, 5s, [conn](int fd, int reason) {
+            OnConnected(conn, fd, reason);
+        });
+    }
+    auto connect_deadline = std::chrono::steady_clock::now() + 10s;
+    while (connected.size() + error_count < connections.size() &&
+        std::chrono::steady_clock::now() < connect_deadline) {
+        EV_HUB.LoopOnce();
+    }
+    if (connected.empty()) {
+        std::cout << "No connection is established.\n";
+        return 1;
+    }
+    std::cout << std::format("{} connections established, {} failed.\n",
+        connected.size(), error_count);
+
+    // Closed-loop: every connection keeps one message in flight, and sends the next one
+    // once the former is back. Open-loop: messages are sent round-robin at a fixed rate.
+    is_measuring = true;
+    auto start_stamp = NowNanoseconds();
+    auto end_stamp = start_stamp + std::chrono::nanoseconds(std::chrono::seconds(options.duration)).count();
+    if (options.rate == 0) {
+        for (const auto& conn : connected) {
+            SendMessage(*conn, start_stamp);
+        }
+    }
+    std::uint64_t interval = options.rate > 0 ? 1'000'000'000ull / options.rate : 0;
+    std::uint64_t next_stamp = start_stamp;
+    std::size_t next_conn = 0;
+    while (true) {
+        auto now = NowNanoseconds();
+        if (now >= end_stamp) {
+            break;
+        }
+        while (interval != 0 && next_stamp <= now && !connected.empty()) {
+            SendMessage(*connected[next_conn++ % connected.size()], next_stamp);
+            next_stamp += interval;
+        }
+        EV_HUB.LoopOnce(false);
+    }
+    is_measuring = false;
+    Report(std::chrono::nanoseconds(NowNanoseconds() - start_stamp));
+
+    for (const auto& conn : connections) {
+        if (conn->fd_ != -1) {
+            close(conn->fd_);
+        }
+    }
+    return 0;
+}
+
+
+std::uint64_t NowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool ParseOptions(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg { argv[i] };
+        auto pos = arg.find('=');
+        if (!arg.starts_with("--") || pos == std::string_view::npos) {
+            return false;
+        }
+        auto key = arg.substr(2, pos - 2);
+        auto value = arg.substr(pos + 1);
+        auto parse_int = [value](auto& field) {
+            return std::from_chars(value.data(), value.data() + value.size(), field).ec == std::errc {};
+        };
+        bool is_valid = true;
+        if (key == "scenario") {
+            options.scenario = value;
+            is_valid = value == "echo" || value == "broadcast" || value == "http";
+        } else if (key == "ip") {
+            options.ip = value;
+        } else if (key == "port") {
+            is_valid = parse_int(options.port);
+        } else if (key == "connections") {
+            is_valid = parse_int(options.connections) && options.connections > 0;
+        } else if (key == "duration") {
+            is_valid = parse_int(options.duration) && options.duration > 0;
+        } else if (key == "rate") {
+            is_valid = parse_int(options.rate) && options.rate >= 0;
+        } else if (key == "size") {
+            is_valid = parse_int(options.size) && options.size > 0;
+        } else {
+            is_valid = false;
+        }
+        if (!is_valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SendMessage(const Connection& conn, std::uint64_t intended_stamp)
+{
+    // The chatroom broadcasts at most 511 bytes of a read, so keep lines shorter.
+    std::string line = std::format("@{}:{}:", conn.id_, intended_stamp);
+    int size = options.scenario == "broadcast" ? std::min(options.size, 400) : options.size;
+    if (static_cast<int>(line.size()) + 1 < size) {
+        line.append(size - line.size() - 1, 'x');
+    }
+    line.push_back('\n');
+    if (options.scenario == "http") {
+        // The body is echoed as the last line of the response, and no other line of
+        // the response contains '@'.
+        EV_HUB.Write(conn.fd_, std::format("POST /echo HTTP/1.1\r\nContent-Length: {}\r\n\r\n", line.size()));
+    }
+    EV_HUB.Write(conn.fd_, line);
+    sent_count++;
+}
+
+void OnConnected(std::shared_ptr<Connection> conn, int fd, int reason)
+{
+    if (fd == -1) {
+        std::cout << std::format("Connection {} failed: {}\n", conn->id_, reason);
+        error_count++;
+        return;
+    }
+    conn->fd_ = fd;
+    connected.push_back(conn);
+    EV_HUB.CreateEmpty(fd, [](int, Event::Type, std::shared_ptr<void>) {});
+    codec::Attach(fd, std::make_shared<codec::FrameReader>(kLineCodec, 64 * 1024),
+        [conn](int, std::string_view line) { OnFrame(conn, line); }, OnClose);
+}
+
+void OnFrame(std::shared_ptr<Connection> conn, std::string_view line)
+{
+    // Broadcast lines are prefixed by the chatroom and lines of HTTP response heads have
+    // no '@', so the message starts from '@'.
+    auto pos = line.find('@');
+    if (pos == std::string_view::npos) {
+        return;
+    }
+    line.remove_prefix(pos + 1);
+    int sender_id = -1;
+    std::uint64_t stamp = 0;
+    auto [id_end, id_error] = std::from_chars(line.data(), line.data() + line.size(), sender_id);
+    if (id_error != std::errc {} || id_end == line.data() + line.size() || *id_end != ':') {
+        return;
+    }
+    auto [_, stamp_error] = std::from_chars(id_end + 1, line.data() + line.size(), stamp);
+    if (stamp_error != std::errc {} || !is_measuring) {
+        return;
+    }
+
+    auto now = NowNanoseconds();
+    latencies.Record(now > stamp ? now - stamp : 0);
+    if (options.rate == 0 && sender_id == conn->id_) {
+        // The message of its own is back, including the broadcast one.
+        SendMessage(*conn, now);
+    }
+}
+
+void OnClose(int fd, int reason)
+{
+    std::cout << std::format("Connection was closed by server: {}\n", reason);
+    std::erase_if(connected, [fd](const auto& conn) { return conn->fd_ == fd; });
+    for (const auto& conn : connections) {
+        if (conn->fd_ == fd) {
+            conn->fd_ = -1;
+        }
+    }
+    EV_HUB.SetCurrent(fd).Destroy();
+    close(fd);
+}
+
+void Report(std::chrono::nanoseconds elapsed)
+{
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    auto micros = [](std::uint64_t nanoseconds) { return nanoseconds / 1000.0; };
+    std::cout << std::format("Scenario: {}, connections: {}, mode: {}\n", options.scenario,
+        connected.size(), options.rate == 0 ? "closed-loop" : std::format("open-loop at {}/s", options.rate));
+    std::cout << std::format("Sent: {} ({:.0f}/s), received: {} ({:.0f}/s)\n",
+        sent_count, sent_count / seconds, latencies.TotalCount(), latencies.TotalCount() / seconds);
+    std::cout << std::format("Latency (us): p50 {:.1f}, p90 {:.1f}, p99 {:.1f}, p99.9 {:.1f}, max {:.1f}\n",
+        micros(latencies.Percentile(50)), micros(latencies.Percentile(90)),
+        micros(latencies.Percentile(99)), micros(latencies.Percentile(99.9)), micros(latencies.Max()));
+}
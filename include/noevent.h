@@ -5,10 +5,20 @@
 #include <unordered_map>
 #include <memory>
 #include <list>
+#include <map>
 #include <vector>
 #include <queue>
 #include <bitset>
+#include <concepts>
 #include <optional>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <span>
+#include <utility>
+
+#include <cstdint>
+#include <cstdlib>
 
 #include <unistd.h>
 
@@ -18,6 +28,14 @@ namespace noevent
 
 // #define DEBUG
 
+// Exceptions are only thrown by the builder API at the edges, while the dispatch path
+// is built on error codes. Misuse aborts instead if exceptions are disabled.
+#ifdef __cpp_exceptions
+#define NOEVENT_THROW(exception)  throw exception
+#else
+#define NOEVENT_THROW(exception)  std::abort()
+#endif
+
 namespace utils
 {
 
@@ -50,6 +68,76 @@ private:
     std::vector<int> data_;
 };
 
+class TokenBucket
+{
+public:
+    // `rate` tokens are refilled per second and at most `burst` tokens can be saved.
+    // A token usually stands for a byte, but it is up to users since they consume it.
+    TokenBucket(std::int64_t rate, std::int64_t burst);
+
+    void Refill(std::chrono::time_point<std::chrono::system_clock> now);
+    void Consume(std::int64_t tokens) { tokens_ -= tokens; }
+
+    bool Empty() const { return tokens_ <= 0; }
+    std::int64_t Tokens() const { return tokens_; }
+
+private:
+    std::int64_t rate_;
+    std::int64_t burst_;
+    std::int64_t tokens_;
+    std::chrono::time_point<std::chrono::system_clock> refill_stamp_;
+};
+
+class BufferPool;
+
+// A buffer taken from a pool, which goes back to the pool once it is destroyed.
+class PooledBuffer
+{
+public:
+    PooledBuffer() = default;
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+    ~PooledBuffer();
+
+    char* Data() const { return data_.get(); }
+    std::size_t Size() const { return size_; }
+    std::size_t Capacity() const;
+    bool Empty() const { return data_ == nullptr; }
+
+    void Resize(std::size_t size) { size_ = size; }
+
+private:
+    friend class BufferPool;
+
+    BufferPool* pool_ { nullptr };
+    std::unique_ptr<char[]> data_ { nullptr };
+    int size_class_ { 0 };
+    std::size_t size_ { 0 };
+};
+
+class BufferPool
+{
+public:
+    // Buffers of a class are `kMinClassSize << size_class` bytes, from 4KB to 64KB.
+    static constexpr std::size_t kMinClassSize { 4096 };
+    static constexpr int kClassCount { 5 };
+
+    // At most `max_free_count` free buffers are kept for each class.
+    explicit BufferPool(std::size_t max_free_count = 256) : max_free_count_ { max_free_count } {}
+
+    PooledBuffer Acquire(int size_class);
+    std::size_t FreeBytes() const;
+
+private:
+    friend class PooledBuffer;
+
+    void Release(std::unique_ptr<char[]> data, int size_class);
+
+    std::size_t max_free_count_;
+    std::vector<std::unique_ptr<char[]>> free_lists_[kClassCount];
+};
+
 }  // namespace noevent::utils
 
 
@@ -63,9 +151,18 @@ public:
 
     virtual ~SystemEventOperation() { if (sys_evop_fd_ != -1) close(sys_evop_fd_); }
 
-    virtual void Add(int fd) = 0;
-    virtual void Del(int fd) = 0;
-    virtual void Poll(std::chrono::seconds waitting_time) = 0;
+    // All of them return 0 on success, or `errno` otherwise.
+    virtual int Add(int fd) noexcept = 0;
+    virtual int Del(int fd) noexcept = 0;
+    // Re-register a registered event with its latest interests.
+    virtual int Mod(int fd) noexcept = 0;
+    virtual int Poll(std::chrono::milliseconds waitting_time) noexcept = 0;
+
+    // The clock of the hub, which could be a virtual one.
+    virtual std::chrono::time_point<std::chrono::system_clock> Now() const noexcept
+    {
+        return std::chrono::system_clock::now();
+    }
 
 protected:
     int sys_evop_fd_ { -1 };
@@ -79,11 +176,15 @@ public:
 
     virtual ~Epoll() = default;
 
-    virtual void Add(int fd) override;
-    virtual void Del(int fd) override;
-    virtual void Poll(std::chrono::seconds waitting_time) override;
+    // Defined inline in "noevent_epoll.h", so the hub calls them without the vtable.
+    inline virtual int Add(int fd) noexcept override;
+    inline virtual int Del(int fd) noexcept override;
+    inline virtual int Mod(int fd) noexcept override;
+    inline virtual int Poll(std::chrono::milliseconds waitting_time) noexcept override;
 
 private:
+    inline int Control(int fd, int operation) noexcept;
+
     int registered_event_count_ { 0 };
 };
 #endif
@@ -96,15 +197,92 @@ public:
 
     virtual ~KQueue() = default;
 
-    virtual void Add(int fd) override;
-    virtual void Del(int fd) override;
-    virtual void Poll(std::chrono::seconds waitting_time) override;
+    // Defined inline in "noevent_kqueue.h", so the hub calls them without the vtable.
+    inline virtual int Add(int fd) noexcept override;
+    inline virtual int Del(int fd) noexcept override;
+    inline virtual int Mod(int fd) noexcept override;
+    inline virtual int Poll(std::chrono::milliseconds waitting_time) noexcept override;
 
 private:
     int registered_event_count_ { 0 };
 };
 #endif
 
+// Replays readiness in memory with a virtual clock, so the overhead of the hub itself can
+// be measured without syscalls and timeouts are ordered deterministically. Readiness is
+// level-triggered, it stays pending until it is delivered to a registered event. Once
+// nothing is pending, the clock jumps straight to the next readiness or wakeup of the hub.
+class MemoryEventOperation final : public SystemEventOperation
+{
+public:
+    enum class Readiness
+    {
+        kRead,
+        kWrite,
+        kError,  // delivered as `ECONNRESET` regardless of interests
+    };
+    struct TraceEntry
+    {
+        std::chrono::microseconds at;  // since the start of the virtual clock
+        int fd;
+        Readiness readiness;
+    };
+
+    // The virtual clock starts from the real time by default, so stamps taken before the
+    // backend is set (e.g. of token buckets) are still meaningful.
+    explicit MemoryEventOperation(std::chrono::time_point<std::chrono::system_clock> start_stamp =
+        std::chrono::system_clock::now()) : start_stamp_ { start_stamp }, now_ { start_stamp } {}
+
+    virtual ~MemoryEventOperation() = default;
+
+    virtual int Add(int fd) noexcept override;
+    virtual int Del(int fd) noexcept override;
+    virtual int Mod(int fd) noexcept override;
+    virtual int Poll(std::chrono::milliseconds waitting_time) noexcept override;
+    virtual std::chrono::time_point<std::chrono::system_clock> Now() const noexcept override { return now_; }
+
+    // Entries are merged into the trace by their time, and those in the past are pending
+    // at once. Each line of a text trace is "<microseconds> <fd> <r|w|e>".
+    void Replay(std::vector<TraceEntry> trace);
+    static std::vector<TraceEntry> ParseTrace(std::string_view text);
+    void Inject(int fd, Readiness readiness);
+
+    // Whether the trace is over and no readiness is pending for registered fds.
+    bool IsDrained() const;
+    std::uint64_t PollCount() const { return poll_count_; }
+
+private:
+    std::uint8_t InterestOf(int fd) const noexcept;
+
+    std::chrono::time_point<std::chrono::system_clock> start_stamp_;
+    std::chrono::time_point<std::chrono::system_clock> now_;
+    std::vector<TraceEntry> trace_;
+    std::size_t next_entry_ { 0 };
+    std::unordered_map<int, std::uint8_t> interests_;
+    std::map<int, std::uint8_t> pending_;  // ordered by fd, so delivery is deterministic
+    std::uint64_t poll_count_ { 0 };
+};
+
+// The contract of a system event operation. The built-in backend of the hub is chosen
+// at compile time and called directly, and its operations are defined inline for the
+// loop. A backend set by `EventHub::SetBackend()` is called virtually instead.
+template <typename T>
+concept SystemEventBackend = requires(T& sys_ev_op, int fd, std::chrono::milliseconds waitting_time) {
+    { sys_ev_op.Add(fd) } noexcept -> std::same_as<int>;
+    { sys_ev_op.Del(fd) } noexcept -> std::same_as<int>;
+    { sys_ev_op.Mod(fd) } noexcept -> std::same_as<int>;
+    { sys_ev_op.Poll(waitting_time) } noexcept -> std::same_as<int>;
+    { std::as_const(sys_ev_op).Now() } noexcept -> std::same_as<std::chrono::time_point<std::chrono::system_clock>>;
+};
+
+#if defined(__APPLE__)
+using Backend = KQueue;
+#elif defined(__linux__)
+using Backend = Epoll;
+#endif
+static_assert(SystemEventBackend<Backend>);
+static_assert(SystemEventBackend<SystemEventOperation>);
+
 }  // namespace noevent::internal
 
 
@@ -132,31 +310,111 @@ private:
 #elif defined(__APPLE__)
     friend class internal::KQueue;
 #endif
+    friend class internal::MemoryEventOperation;
 
     bool is_locked { false };
+    bool is_destroyed { false };
     enum class Where
     {
         kInReady,
         kInTimeout,
         kInActive,
+        kInThrottled,
+        kInDirty,
+        kInSystem,  // registered to the system event operation
     };
-    std::bitset<3> where_;
+    std::bitset<6> where_;
 
     int fd_ { -1 };
     std::shared_ptr<void> data_ { nullptr };
     std::bitset<4> result_;
+    int error_ { 0 };  // `errno` of the latest error
 
     Callback write_cb_ { nullptr };
     Callback read_cb_ { nullptr };
     Callback error_cb_ { nullptr };
 
+    // The first one is owned by the event and the second one is shared by a group.
+    std::shared_ptr<utils::TokenBucket> read_limits_[2] { nullptr, nullptr };
+    std::shared_ptr<utils::TokenBucket> write_limits_[2] { nullptr, nullptr };
+    // A direction is parked once its buckets are empty or by overload control, which
+    // leaves it out of registration until ticks resume it, while the other one is not.
+    bool is_read_parked { false };
+    bool is_write_parked { false };
+
+    // Interests to be registered, and pending output is never parked.
+    bool WantsRead() const { return read_cb_ != nullptr && !is_read_parked; }
+    bool WantsWrite() const { return (write_cb_ != nullptr && !is_write_parked) || !outbox_.empty(); }
+
+    // Shared payloads waiting to be flushed, and `outbox_offset_` bytes of the front one
+    // have been written. A payload is freed once the last event has flushed it.
+    std::deque<std::shared_ptr<const std::string>> outbox_;
+    std::size_t outbox_offset_ { 0 };
+    // Bytes copied by `Write()` are staged here, so small writes of an iteration are
+    // sealed into a single payload.
+    std::string staging_;
+    bool is_socket { true };  // flushed by `sendmsg()` until it fails with `ENOTSOCK`
+
+    // An optimistic event is probed before being registered, and the probing is skipped
+    // for exponentially more times after each miss, so it costs little if it is rarely ready.
+    bool is_optimistic { false };
+    std::uint32_t probe_backoff_ { 0 };
+    std::uint32_t probe_skips_ { 0 };
+    std::uint64_t probe_hits_ { 0 };
+    std::uint64_t probe_misses_ { 0 };
+
+    // An auto-read event is read by the hub into a pooled buffer before its read callback,
+    // so an idle event holds no buffer. `read_class_` adapts to the sizes read recently.
+    bool is_listener { false };
+    bool is_deferred { false };
+    std::uint32_t read_cost_ { 0 };  // moving average of read callbacks in microseconds
+
+    bool is_auto_read { false };
+    std::uint8_t read_class_ { 0 };
+    utils::PooledBuffer read_buffer_;
+
+    // `timeout_stamp_` is the key in timeout heap while `deadline_stamp_` is the real one,
+    // which could be prolonged without touching the heap.
+    std::chrono::seconds timeout_period_ { 0 };
+    // How late the timeout may fire, so that close deadlines are expired in one wakeup.
+    // The slack of the hub is used if it is not set.
+    std::optional<std::chrono::milliseconds> timer_slack_;
     std::chrono::time_point<std::chrono::system_clock> timeout_stamp_;
+    std::chrono::time_point<std::chrono::system_clock> deadline_stamp_;
+    // The latest time when the timeout may fire, which is the key plus the slack.
+    std::chrono::time_point<std::chrono::system_clock> fire_stamp_;
+    // The entry in timeout heap is left there once the event is responsed, and it is
+    // dropped when it expires unless the callbacks re-arm the timeout.
+    bool is_timeout_stale { false };
+    bool is_responsing { false };
 };
 
 
+// Levels of overload, and each one includes policies of the lower ones.
+enum class OverloadLevel
+{
+    kNone,
+    kDeprioritizing,  // heavy readers are responsed after others
+    kPausingAccept,   // listeners are not armed
+    kParkingReads,    // no read-only event is armed
+};
+
+// The loop lag is how late `Poll()` returns compared to the intended wakeup. A level
+// takes effect once the lag reaches its threshold, and the hub does not go back to a
+// lower level until the lag is below `recovery_lag`.
+struct OverloadPolicy
+{
+    std::chrono::milliseconds deprioritize_lag { 50 };
+    std::chrono::milliseconds pause_accept_lag { 100 };
+    std::chrono::milliseconds park_reads_lag { 500 };
+    std::chrono::milliseconds recovery_lag { 20 };
+};
+
 class EventHub final : public utils::Singleton
 {
 public:
+    using OverloadCallback = std::function<void(OverloadLevel, std::chrono::microseconds)>;
+
     static EventHub& Instance();
 
     EventHub& CreateEmpty(int fd, Event::Callback error_cb);
@@ -164,6 +422,15 @@ public:
     EventHub& OnRead(Event::Callback read_cb);
     EventHub& OnWrite(Event::Callback write_cb);
     EventHub& WithData(std::shared_ptr<void> data);
+    EventHub& WithSlack(std::chrono::milliseconds timer_slack);
+    EventHub& LimitRead(std::shared_ptr<utils::TokenBucket> bucket,
+        std::shared_ptr<utils::TokenBucket> group = nullptr);
+    EventHub& LimitWrite(std::shared_ptr<utils::TokenBucket> bucket,
+        std::shared_ptr<utils::TokenBucket> group = nullptr);
+    EventHub& Optimistic(bool is_optimistic = true);
+    EventHub& AutoRead(bool is_auto_read = true);
+    EventHub& Cork(bool is_corked = true);
+    EventHub& AsListener(bool is_listener = true);
 
     bool IsReadEnabled(int fd) const;
     bool IsWriteEnabled(int fd) const;
@@ -171,13 +438,49 @@ public:
     bool IsInTimeout(int fd) const;
     bool IsInReady(int fd) const;
     bool IsInActive(int fd) const;
+    bool IsInThrottled(int fd) const;
+    bool HasPendingOutput(int fd) const;
+    bool HasEvent(int fd) const { return events.contains(fd); }
+    bool IsListener(int fd) const { return events.at(fd)->is_listener; }
 
     int GetCurrent() const { return current_fd_; }
+    std::shared_ptr<void> GetData(int fd) const { return events.at(fd)->data_; }
+    int GetError(int fd) const { return events.at(fd)->error_; }
+    // Hits and misses of probing for an optimistic event.
+    std::pair<std::uint64_t, std::uint64_t> GetProbeStats(int fd) const;
+    // Bytes read by the hub for an auto-read event, which are only valid in its read
+    // callback unless the buffer is taken. They are empty if the peer closed.
+    std::span<const char> ReadBuffer(int fd) const;
+    utils::PooledBuffer TakeBuffer(int fd);
     int EventsCount() const { return events.size(); }
+    std::vector<int> GetFds() const;
+    std::optional<std::chrono::milliseconds> GetRemainingTimeout(int fd) const;
+    std::chrono::microseconds GetLoopLag() const { return loop_lag_; }
+    OverloadLevel GetOverloadLevel() const { return overload_level_; }
 
     void Ready(std::optional<std::chrono::seconds> timeout_period = std::nullopt);
+    void Activate(int fd, Event::Type result);
+    void Prolong(int fd, std::chrono::seconds timeout_period);
+    void Touch(int fd);
     void Destroy();
-    void LoopOnce(bool can_block = true);
+    void Consume(int fd, Event::Type type, std::int64_t tokens);
+    void Write(int fd, std::string_view data, bool is_urgent = false);
+    // Unsent bytes are taken out of the event, and they will never be flushed by the hub.
+    std::string TakePendingOutput(int fd);
+    void Send(int fd, std::shared_ptr<const std::string> payload);
+    void Broadcast(std::shared_ptr<const std::string> payload, std::span<const int> fds);
+    void SetTickPeriod(std::chrono::milliseconds tick_period);
+    void SetTimerSlack(std::chrono::milliseconds timer_slack);
+    // Overload control is disabled by `std::nullopt`, which is the default.
+    void SetOverloadPolicy(std::optional<OverloadPolicy> policy);
+    void SetOverloadCallback(OverloadCallback overload_cb) { overload_cb_ = std::move(overload_cb); }
+    // Replace the built-in backend, which is only allowed without any event, and
+    // `nullptr` restores it.
+    void SetBackend(std::unique_ptr<internal::SystemEventOperation> sys_ev_op);
+    // Returns 0, or errno of a failed poll instead of throwing, and the loop still
+    // handles timeouts and output. Errors of an event are read by `GetError()` in its
+    // error callback.
+    int LoopOnce(bool can_block = true);
 
 private:
     friend class utils::EventMinHeap;
@@ -186,30 +489,94 @@ private:
 #elif defined(__APPLE__)
     friend class internal::KQueue;
 #endif
+    friend class internal::MemoryEventOperation;
 
-    EventHub();
+    EventHub() = default;
+
+    // The built-in backend is called directly unless it is replaced, and the branch is
+    // always predicted.
+    std::chrono::time_point<std::chrono::system_clock> Now() const noexcept
+    {
+        return replaced_ev_op_ == nullptr ? sys_ev_op_.Now() : replaced_ev_op_->Now();
+    }
+    int BackendAdd(int fd) noexcept
+    {
+        return replaced_ev_op_ == nullptr ? sys_ev_op_.Add(fd) : replaced_ev_op_->Add(fd);
+    }
+    int BackendDel(int fd) noexcept
+    {
+        return replaced_ev_op_ == nullptr ? sys_ev_op_.Del(fd) : replaced_ev_op_->Del(fd);
+    }
+    int BackendMod(int fd) noexcept
+    {
+        return replaced_ev_op_ == nullptr ? sys_ev_op_.Mod(fd) : replaced_ev_op_->Mod(fd);
+    }
+    int BackendPoll(std::chrono::milliseconds waitting_time) noexcept
+    {
+        return replaced_ev_op_ == nullptr ? sys_ev_op_.Poll(waitting_time) : replaced_ev_op_->Poll(waitting_time);
+    }
+    // The dispatch path only looks up fds which are known to exist.
+    const std::shared_ptr<Event>& FindEvent(int fd) noexcept { return events.find(fd)->second; }
 
     void PreprocessReadyEvents();
-    std::chrono::seconds CalculateWaittingTime();
+    std::chrono::time_point<std::chrono::system_clock> CalculateWakeupStamp();
+    std::chrono::milliseconds CalculateWaittingTime();
+    void CheckOverload(std::chrono::time_point<std::chrono::system_clock> intended_stamp);
     void CheckTimeoutEvents();
+    void CheckThrottledEvents();
     void ResponseActiveEvents();
+    void FlushDirtyEvents();
 
+    void TimeoutSchedule(int fd, std::chrono::time_point<std::chrono::system_clock> deadline);
     void TimeoutPush(int fd);
     void TimeoutRemove(int fd);
     void ReadyPush(int fd);
     int ReadyFrontAndPop();
+    bool Probe(const std::shared_ptr<Event>& ev);
+    bool FillReadBuffer(const std::shared_ptr<Event>& ev);
+    void SystemDel(const std::shared_ptr<Event>& ev);
     void ActivePush(int fd);
     int ActiveFrontAndPop();
-
+    bool Park(const std::shared_ptr<Event>& ev);
+    void ThrottledPush(int fd);
+    void ThrottledRemove(int fd);
+    void SealStaging(const std::shared_ptr<Event>& ev);
+    bool FlushOutbox(const std::shared_ptr<Event>& ev);
+    void WaitWritable(const std::shared_ptr<Event>& ev);
+    void KeepWritable(const std::shared_ptr<Event>& ev);
+    void DirtyPush(int fd);
+    void DirtyRemove(int fd);
+
+    // The pool is declared first, so it outlives buffers held by events.
+    utils::BufferPool buffer_pool_;
     std::unordered_map<int, std::shared_ptr<Event>> events;
     int current_fd_ { -1 };
     std::queue<int> ready_fds_;
     utils::EventMinHeap timeout_heap_;
+    // Fire stamps of the timeout heap, so the wakeup is known without walking the heap.
+    // Entries no longer matching their events are dropped once they reach the top.
+    std::priority_queue<std::pair<std::chrono::time_point<std::chrono::system_clock>, int>,
+        std::vector<std::pair<std::chrono::time_point<std::chrono::system_clock>, int>>,
+        std::greater<>> fire_stamps_;
     std::queue<int> active_fds_;
-    std::unique_ptr<internal::SystemEventOperation> sys_ev_op_ { nullptr };
+    std::list<int> throttled_fds_;
+    std::vector<int> dirty_fds_;
+    std::chrono::milliseconds tick_period_ { 100 };
+    std::chrono::milliseconds timer_slack_ { 0 };
+    std::optional<OverloadPolicy> overload_policy_;
+    OverloadCallback overload_cb_ { nullptr };
+    OverloadLevel overload_level_ { OverloadLevel::kNone };
+    std::chrono::microseconds loop_lag_ { 0 };
+    std::uint32_t avg_read_cost_ { 0 };
+    std::chrono::time_point<std::chrono::system_clock> tick_stamp_ { std::chrono::system_clock::now() };
+    internal::Backend sys_ev_op_;
+    std::unique_ptr<internal::SystemEventOperation> replaced_ev_op_ { nullptr };
 };
 
 #define EV_HUB  (EventHub::Instance())
 
 
-}  // namespace noevent
\ No newline at end of file
+}  // namespace noevent
+
+#include "noevent_epoll.h"
+#include "noevent_kqueue.h"
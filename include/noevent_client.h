@@ -0,0 +1,67 @@
+#pragma once
+
+#include <functional>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <cstdint>
+
+#include "noevent.h"
+
+
+namespace noevent::client
+{
+
+// The first argument is the connected fd, or -1 if it failed, and the second one is
+// 0 or the reason, which is `ETIMEDOUT` when the deadline is exceeded.
+using ConnectCallback = std::function<void(int, int)>;
+
+// Connect to an IPv4 destination without blocking the loop. The connecting fd is
+// registered to `EV_HUB` until the connection is established, then it is destroyed
+// from the hub and handed to the callback, so users can create their own event.
+// An immediate failure (e.g. a malformed address) is reported before returning.
+void Connect(std::string_view ip, std::uint16_t port, std::chrono::seconds timeout_period,
+    ConnectCallback on_connected);
+
+
+// Keeps warm connections per destination. Idle connections are not registered to
+// the hub, they are checked when they are acquired and evicted once they are idle
+// for too long, closed by the peer or beyond the max idle count.
+class ConnectionPool final
+{
+public:
+    ConnectionPool(std::size_t max_idle_count = 8,
+        std::chrono::seconds idle_timeout_period = std::chrono::seconds { 60 },
+        std::chrono::seconds connect_timeout_period = std::chrono::seconds { 3 });
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    ~ConnectionPool();
+
+    // Hand a warm connection to the callback immediately, or connect a new one.
+    void Acquire(std::string_view ip, std::uint16_t port, ConnectCallback on_acquired);
+    // Give back a healthy connection whose event has been destroyed from the hub.
+    void Release(std::string_view ip, std::uint16_t port, int fd);
+    std::size_t IdleCount(std::string_view ip, std::uint16_t port);
+
+private:
+    struct IdleConnection
+    {
+        int fd_;
+        std::chrono::time_point<std::chrono::steady_clock> idle_stamp_;
+    };
+
+    std::vector<IdleConnection>& Evict(std::string_view ip, std::uint16_t port);
+
+    std::size_t max_idle_count_;
+    std::chrono::seconds idle_timeout_period_;
+    std::chrono::seconds connect_timeout_period_;
+    std::unordered_map<std::string, std::vector<IdleConnection>> idle_connections_;
+};
+
+
+}  // namespace noevent::client
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <cstdint>
+#include <cstddef>
+
+#include "noevent.h"
+
+
+namespace noevent::codec
+{
+
+// What a codec knows about the first frame when it is still incomplete.
+struct DecodeState
+{
+    std::size_t frame_size { 0 };  // length of the whole frame once the prefix is decoded
+    std::size_t scanned { 0 };     // bytes searched for the delimiter so far
+};
+
+class Codec
+{
+public:
+    static constexpr std::size_t kMalformed { static_cast<std::size_t>(-1) };
+
+    virtual ~Codec() = default;
+
+    // Decode the first frame of `input` and return the length of the whole frame, 0 if
+    // the frame is incomplete, or `kMalformed`. The payload is a view into `input`.
+    virtual std::size_t Decode(std::string_view input, std::string_view& payload,
+        DecodeState& state) const = 0;
+    // Encode the payload into a frame, which could be sent by `Send()` or `Broadcast()`.
+    virtual std::shared_ptr<const std::string> Encode(std::string_view payload) const = 0;
+};
+
+class LengthCodec final : public Codec
+{
+public:
+    enum class Prefix
+    {
+        kVarint,   // unsigned LEB128, as protobuf does
+        kFixed8,
+        kFixed16,  // big endian for all fixed prefixes
+        kFixed32,
+        kFixed64,
+    };
+
+    explicit LengthCodec(Prefix prefix) : prefix_ { prefix } {}
+
+    virtual std::size_t Decode(std::string_view input, std::string_view& payload,
+        DecodeState& state) const override;
+    virtual std::shared_ptr<const std::string> Encode(std::string_view payload) const override;
+
+private:
+    Prefix prefix_;
+};
+
+class DelimiterCodec final : public Codec
+{
+public:
+    explicit DelimiterCodec(std::string delimiter);
+
+    virtual std::size_t Decode(std::string_view input, std::string_view& payload,
+        DecodeState& state) const override;
+    virtual std::shared_ptr<const std::string> Encode(std::string_view payload) const override;
+
+private:
+    std::string delimiter_;
+};
+
+
+// Accumulates bytes of an fd and delivers complete frames as views into its own
+// buffer, which are valid until the frame callback returns. A partial frame stays
+// where it was read, and the buffer is grown for a known frame size in advance, so
+// the rest of the frame is read in place instead of being copied again.
+class FrameReader final
+{
+public:
+    using FrameCallback = std::function<void(int, std::string_view)>;
+    // The second argument is 0 if the peer closed, `EMSGSIZE` if the frame is too
+    // large, `EBADMSG` if the frame is malformed, or `errno` of `read`.
+    using CloseCallback = std::function<void(int, int)>;
+
+    FrameReader(std::shared_ptr<const Codec> codec, std::size_t max_frame_size = 1 << 20);
+
+    FrameReader(const FrameReader&) = delete;
+    FrameReader& operator=(const FrameReader&) = delete;
+
+    // Read once and deliver all complete frames. Returns -1 if the fd is still fine,
+    // otherwise the reason described in `CloseCallback`. `max_frame_size` limits the
+    // whole frame including its prefix or delimiter. Delivery stops once the frame
+    // callback destroys the event of the fd.
+    int ReadFrom(int fd, const FrameCallback& on_frame);
+
+    std::size_t Buffered() const { return end_ - begin_; }
+
+private:
+    void Reserve(std::size_t size);
+
+    std::shared_ptr<const Codec> codec_;
+    std::size_t max_frame_size_;
+    DecodeState state_;
+    std::unique_ptr<char[]> buffer_ { nullptr };
+    std::size_t capacity_ { 0 };
+    std::size_t begin_ { 0 };
+    std::size_t end_ { 0 };
+};
+
+// Let `EV_HUB` read frames of the event, which is re-armed with the timeout period
+// after every read until the fd is closed by peer or broken. The fd is not closed or
+// destroyed here, and timeout still goes to the error callback of the event.
+void Attach(int fd, std::shared_ptr<FrameReader> reader, FrameReader::FrameCallback on_frame,
+    FrameReader::CloseCallback on_close,
+    std::optional<std::chrono::seconds> timeout_period = std::nullopt);
+
+
+}  // namespace noevent::codec
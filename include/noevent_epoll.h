@@ -0,0 +1,100 @@
+#pragma once
+
+// Operations of the built-in backend are defined inline here, so the loop calls them
+// without going through the vtable or relying on link time optimization. It is included
+// by the end of "noevent.h" and should not be included directly.
+
+#include <algorithm>
+#include <cerrno>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#endif
+
+
+namespace noevent::internal
+{
+
+#ifdef __linux__
+
+
+inline int Epoll::Add(int fd) noexcept
+{
+    if (int error = Control(fd, EPOLL_CTL_ADD); error != 0) {
+        return error;
+    }
+    registered_event_count_++;
+    return 0;
+}
+
+inline int Epoll::Del(int fd) noexcept
+{
+    if (epoll_ctl(sys_evop_fd_, EPOLL_CTL_DEL, fd, nullptr)) {
+        return errno;
+    }
+    registered_event_count_--;
+    return 0;
+}
+
+inline int Epoll::Mod(int fd) noexcept
+{
+    return Control(fd, EPOLL_CTL_MOD);
+}
+
+inline int Epoll::Poll(std::chrono::milliseconds waitting_time) noexcept
+{
+    // `epoll_wait` refuses zero capacity, which happens when all events are throttled.
+    std::vector<struct epoll_event> active_epoll_evs(std::max(registered_event_count_, 1));
+    int nactive = epoll_wait(sys_evop_fd_, active_epoll_evs.data(), active_epoll_evs.size(),
+        waitting_time.count());
+    if (nactive < 0) {
+        return errno;
+    }
+
+    for (int i = 0; i < nactive; ++i) {
+        const auto& current_ev = EV_HUB.FindEvent(active_epoll_evs[i].data.fd);
+        if (active_epoll_evs[i].events & EPOLLIN) {
+            current_ev->result_.set((int)Event::Type::kRead, true);
+        }
+        if (active_epoll_evs[i].events & EPOLLOUT) {
+            current_ev->result_.set((int)Event::Type::kWrite, true);
+        }
+        if (current_ev->result_.none() && (active_epoll_evs[i].events & EPOLLERR)) {
+            // Neither readable nor writable, so the error goes to the error callback.
+            socklen_t error_len = sizeof(current_ev->error_);
+            getsockopt(current_ev->fd_, SOL_SOCKET, SO_ERROR, &current_ev->error_, &error_len);
+            current_ev->result_.set((int)Event::Type::kError, true);
+        }
+        if (!current_ev->where_.test((int)Event::Where::kInActive)) {
+            // It may have been activated manually.
+            EV_HUB.ActivePush(current_ev->fd_);
+        }
+    }
+    return 0;
+}
+
+inline int Epoll::Control(int fd, int operation) noexcept
+{
+    const auto& current_ev = EV_HUB.FindEvent(fd);
+    struct epoll_event epoll_ev;
+    epoll_ev.events = 0;
+    epoll_ev.data.fd = current_ev->fd_;
+
+    if (current_ev->WantsWrite()) {
+        epoll_ev.events |= EPOLLOUT;
+    }
+    if (current_ev->WantsRead()) {
+        epoll_ev.events |= EPOLLIN;
+    }
+
+    if (epoll_ctl(sys_evop_fd_, operation, fd, &epoll_ev)) {
+        return errno;
+    }
+    return 0;
+}
+
+
+#endif
+
+}  // namespace noevent::internal
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <chrono>
+#include <string>
+
+#include "noevent.h"
+
+
+namespace noevent::handoff
+{
+
+// What the predecessor knows about an event. Callbacks cannot be handed off, so the
+// successor rebinds them by itself, usually with the help of `state`.
+struct Record
+{
+    int fd { -1 };  // a duplicate owned by the successor
+    bool read_enabled { false };
+    bool write_enabled { false };
+    bool is_listener { false };
+    std::optional<std::chrono::milliseconds> remaining_timeout;
+    std::string state;  // opaque to the hub, which is produced by `StateCallback`
+};
+
+// Produces the state of an event, which could be empty.
+using StateCallback = std::function<std::string(int)>;
+// Creates the event in the successor's hub and arms it as the record says, or closes
+// the fd if it is unwanted.
+using AdoptCallback = std::function<void(const Record&)>;
+
+// Hand every event of `EV_HUB` to the successor listening on the Unix socket `path`,
+// and unsent bytes of the events go along with them. It blocks until all events are
+// sent, and returns 0 on success or `errno` otherwise. Since fds are shared by both
+// processes, the predecessor should stop its loop and exit afterwards without calling
+// `shutdown()`, and listeners keep accepting in the meantime.
+int Transfer(const std::string& path, const StateCallback& get_state = nullptr);
+
+// Wait for the predecessor on the Unix socket `path`, and adopt the events one by one.
+// Unsent bytes of an adopted event are written by `EV_HUB.Write()` once it is adopted.
+// It blocks until the predecessor is done, and returns 0 on success or `errno` otherwise.
+int Receive(const std::string& path, const AdoptCallback& adopt);
+
+
+}  // namespace noevent::handoff
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <cstdint>
+
+#include "noevent.h"
+
+
+namespace noevent::http
+{
+
+namespace utils
+{
+
+// Returns the first '\r' or '\n' in [begin, end), or `end` if there is none.
+// SSE4.2 or AVX2 is used if the library is compiled with it.
+const char* FindLineEnd(const char* begin, const char* end);
+
+bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs);
+
+}  // namespace noevent::http::utils
+
+
+struct Header
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+// All views point into the input buffer, so a request is only valid until the
+// buffer is changed, which is after the handler returns.
+struct Request
+{
+    static constexpr int kMaxHeaders { 64 };
+
+    std::string_view method;
+    std::string_view target;
+    int minor_version { 1 };
+    Header headers[kMaxHeaders];
+    int header_count { 0 };
+    std::string_view body;
+    bool keep_alive { true };
+
+    std::string_view GetHeader(std::string_view name) const;
+};
+
+struct Response
+{
+    int status { 200 };
+    std::string reason { "OK" };
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+};
+
+// Returns the length of the parsed request, 0 if the request is incomplete, or -1 if
+// the request is malformed. Only requests with a `Content-Length` body are supported.
+int ParseRequest(std::string_view input, Request& request);
+
+
+class Server final
+{
+public:
+    using Handler = std::function<void(const Request&, Response&)>;
+
+    explicit Server(Handler handler) : handler_ { std::move(handler) } {}
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Listen on the port and register the listener to `EV_HUB`. Users still drive
+    // the loop by themselves, and the server must outlive the loop.
+    void Listen(std::uint16_t port, int backlog = 128);
+    void SetIdleTimeout(std::chrono::seconds idle_timeout) { idle_timeout_ = idle_timeout; }
+    void SetMaxRequestSize(std::size_t max_request_size) { max_request_size_ = max_request_size; }
+
+private:
+    struct Connection
+    {
+        std::string buffer_;
+        bool is_closing { false };
+    };
+
+    void OnAccept(int fd);
+    void OnReadable(int fd, std::shared_ptr<Connection> conn);
+    void OnFlushed(int fd);
+    void Reply(int fd, const Request& request, Response& response);
+    void Close(int fd);
+
+    Handler handler_;
+    int listen_fd_ { -1 };
+    std::chrono::seconds idle_timeout_ { 60 };
+    std::size_t max_request_size_ { 64 * 1024 };
+};
+
+
+}  // namespace noevent::http
@@ -0,0 +1,107 @@
+#pragma once
+
+// Operations of the built-in backend are defined inline here, so the loop calls them
+// without going through the vtable or relying on link time optimization. It is included
+// by the end of "noevent.h" and should not be included directly.
+
+#include <cerrno>
+
+#ifdef __APPLE__
+#include <sys/event.h>
+#endif
+
+
+namespace noevent::internal
+{
+
+#ifdef __APPLE__
+
+
+inline int KQueue::Add(int fd) noexcept
+{
+    const auto& current_ev = EV_HUB.FindEvent(fd);
+    struct kevent kev;
+    EV_SET(&kev, current_ev->fd_, 0, EV_ADD|EV_CLEAR, 0, 0, NULL);
+
+    if (current_ev->WantsWrite()) {
+        kev.filter = EVFILT_WRITE;
+        if (kevent(sys_evop_fd_, &kev, 1, NULL, 0, NULL)) {
+            return errno;
+        }
+        registered_event_count_++;
+    }
+    if (current_ev->WantsRead()) {
+        kev.filter = EVFILT_READ;
+        if (kevent(sys_evop_fd_, &kev, 1, NULL, 0, NULL)) {
+            return errno;
+        }
+        registered_event_count_++;
+    }
+    return 0;
+}
+
+inline int KQueue::Del(int fd) noexcept
+{
+    const auto& current_ev = EV_HUB.FindEvent(fd);
+    struct kevent kev;
+    EV_SET(&kev, current_ev->fd_, 0, EV_DELETE, 0, 0, NULL);
+
+    // Interests could have changed since `Add()`, e.g. pending output is flushed or
+    // appended, so a missing filter is not an error here.
+    for (auto filter : { EVFILT_WRITE, EVFILT_READ }) {
+        kev.filter = filter;
+        if (kevent(sys_evop_fd_, &kev, 1, NULL, 0, NULL) == 0) {
+            registered_event_count_--;
+        } else if (errno != ENOENT) {
+            return errno;
+        }
+    }
+    return 0;
+}
+
+inline int KQueue::Mod(int fd) noexcept
+{
+    // Filters are replaced rather than modified, since either of them may come or go.
+    if (int error = Del(fd); error != 0) {
+        return error;
+    }
+    return Add(fd);
+}
+
+inline int KQueue::Poll(std::chrono::milliseconds waitting_time) noexcept
+{
+    std::vector<struct kevent> active_kevs(registered_event_count_);
+    struct timespec ts;
+    ts.tv_sec = static_cast<long>(waitting_time.count() / 1000);
+    ts.tv_nsec = static_cast<long>(waitting_time.count() % 1000 * 1'000'000);
+
+    int nactive = kevent(sys_evop_fd_, NULL, 0, active_kevs.data(), active_kevs.size(), &ts);
+    if (nactive < 0) {
+        return errno;
+    }
+
+    for (int i = 0; i < nactive; ++i) {
+        const auto& current_ev = EV_HUB.FindEvent(active_kevs[i].ident);
+        switch (active_kevs[i].filter)
+        {
+            case EVFILT_READ:
+                current_ev->result_.set((int)Event::Type::kRead, true);
+                break;
+            case EVFILT_WRITE:
+                current_ev->result_.set((int)Event::Type::kWrite, true);
+                break;
+            default:
+                // Only read and write filters are registered.
+                continue;
+        }
+        if (!current_ev->where_.test((int)Event::Where::kInActive)) {
+            EV_HUB.ActivePush(current_ev->fd_);
+        }
+    }
+    return 0;
+}
+
+
+#endif
+
+}  // namespace noevent::internal
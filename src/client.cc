@@ -0,0 +1,159 @@
+#include "noevent_client.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace noevent::client
+{
+
+namespace
+{
+
+// Returns true if the idle connection is neither closed by the peer nor carrying
+// unexpected data.
+bool IsHealthy(int fd)
+{
+    char byte;
+    ssize_t len = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+std::string DestinationKey(std::string_view ip, std::uint16_t port)
+{
+    std::string key { ip };
+    key.append(":").append(std::to_string(port));
+    return key;
+}
+
+}  // namespace
+
+
+void Connect(std::string_view ip, std::uint16_t port, std::chrono::seconds timeout_period,
+    ConnectCallback on_connected)
+{
+    if (on_connected == nullptr) {
+        NOEVENT_THROW(std::invalid_argument("[noevent] - connect callback cannot be nullptr."));
+    }
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, std::string(ip).c_str(), &addr.sin_addr) != 1) {
+        on_connected(-1, EINVAL);
+        return;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        on_connected(-1, errno);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) && errno != EINPROGRESS) {
+        int reason = errno;
+        close(fd);
+        on_connected(-1, reason);
+        return;
+    }
+
+    // The result is known once the fd is writable, even if it is connected already.
+    EV_HUB.CreateEmpty(fd, [on_connected](int fd, Event::Type type, std::shared_ptr<void>) {
+            // The hub keeps `errno` of the error, which is taken before destroying.
+            int reason = type == Event::Type::kTimeout ? ETIMEDOUT : EV_HUB.GetError(fd);
+            EV_HUB.SetCurrent(fd).Destroy();
+            close(fd);
+            on_connected(-1, reason != 0 ? reason : EIO);
+        })
+        .OnWrite([on_connected](int fd, Event::Type, std::shared_ptr<void>) {
+            int reason = 0;
+            socklen_t reason_len = sizeof(reason);
+            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &reason, &reason_len)) {
+                reason = errno;
+            }
+            EV_HUB.SetCurrent(fd).Destroy();
+            if (reason != 0) {
+                close(fd);
+                on_connected(-1, reason);
+                return;
+            }
+            on_connected(fd, 0);
+        })
+        .Ready(timeout_period);
+}
+
+
+ConnectionPool::ConnectionPool(std::size_t max_idle_count, std::chrono::seconds idle_timeout_period,
+    std::chrono::seconds connect_timeout_period) :
+    max_idle_count_ { max_idle_count },
+    idle_timeout_period_ { idle_timeout_period },
+    connect_timeout_period_ { connect_timeout_period }
+{
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    for (const auto& [key, idle_connections] : idle_connections_) {
+        for (const auto& idle_conn : idle_connections) {
+            close(idle_conn.fd_);
+        }
+    }
+}
+
+void ConnectionPool::Acquire(std::string_view ip, std::uint16_t port, ConnectCallback on_acquired)
+{
+    auto& idle_connections = Evict(ip, port);
+
+    // The most recently released one is the warmest, so the pool works as a stack.
+    while (!idle_connections.empty()) {
+        int fd = idle_connections.back().fd_;
+        idle_connections.pop_back();
+        if (IsHealthy(fd)) {
+            on_acquired(fd, 0);
+            return;
+        }
+        close(fd);
+    }
+    Connect(ip, port, connect_timeout_period_, std::move(on_acquired));
+}
+
+void ConnectionPool::Release(std::string_view ip, std::uint16_t port, int fd)
+{
+    auto& idle_connections = Evict(ip, port);
+
+    if (idle_connections.size() >= max_idle_count_ || !IsHealthy(fd)) {
+        close(fd);
+        return;
+    }
+    idle_connections.push_back({ fd, std::chrono::steady_clock::now() });
+}
+
+std::size_t ConnectionPool::IdleCount(std::string_view ip, std::uint16_t port)
+{
+    return Evict(ip, port).size();
+}
+
+std::vector<ConnectionPool::IdleConnection>& ConnectionPool::Evict(std::string_view ip,
+    std::uint16_t port)
+{
+    auto& idle_connections = idle_connections_[DestinationKey(ip, port)];
+
+    // Connections are released in order, so the expired ones are at the front.
+    auto deadline = std::chrono::steady_clock::now() - idle_timeout_period_;
+    auto it = std::find_if(idle_connections.begin(), idle_connections.end(),
+        [deadline](const IdleConnection& idle_conn) { return idle_conn.idle_stamp_ > deadline; });
+    std::for_each(idle_connections.begin(), it, [](const IdleConnection& idle_conn) {
+        close(idle_conn.fd_);
+    });
+    idle_connections.erase(idle_connections.begin(), it);
+    return idle_connections;
+}
+
+
+}  // namespace noevent::client
@@ -0,0 +1,254 @@
+#include "noevent_codec.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+
+namespace noevent::codec
+{
+
+std::size_t LengthCodec::Decode(std::string_view input, std::string_view& payload,
+    DecodeState& state) const
+{
+    if (state.frame_size == 0) {
+        // Decode the prefix only once for a frame.
+        std::uint64_t length = 0;
+        std::size_t prefix_size = 0;
+        if (prefix_ == Prefix::kVarint) {
+            while (true) {
+                if (prefix_size == input.size()) {
+                    return 0;
+                }
+                if (prefix_size == 10) {
+                    return kMalformed;
+                }
+                auto byte = static_cast<std::uint8_t>(input[prefix_size]);
+                length |= static_cast<std::uint64_t>(byte & 0x7f) << (7 * prefix_size);
+                prefix_size++;
+                if ((byte & 0x80) == 0) {
+                    break;
+                }
+            }
+        } else {
+            prefix_size = std::size_t { 1 } << ((int)prefix_ - (int)Prefix::kFixed8);
+            if (input.size() < prefix_size) {
+                return 0;
+            }
+            for (std::size_t i = 0; i < prefix_size; ++i) {
+                length = (length << 8) | static_cast<std::uint8_t>(input[i]);
+            }
+        }
+        if (length > kMalformed - prefix_size) {
+            return kMalformed;
+        }
+        state.frame_size = prefix_size + length;
+        state.scanned = prefix_size;
+    }
+
+    if (input.size() < state.frame_size) {
+        return 0;
+    }
+    payload = input.substr(state.scanned, state.frame_size - state.scanned);
+    return state.frame_size;
+}
+
+std::shared_ptr<const std::string> LengthCodec::Encode(std::string_view payload) const
+{
+    std::string frame;
+    std::uint64_t length = payload.size();
+    if (prefix_ == Prefix::kVarint) {
+        do {
+            std::uint8_t byte = length & 0x7f;
+            length >>= 7;
+            frame.push_back(static_cast<char>(length != 0 ? (byte | 0x80) : byte));
+        } while (length != 0);
+    } else {
+        std::size_t prefix_size = std::size_t { 1 } << ((int)prefix_ - (int)Prefix::kFixed8);
+        if (prefix_size < 8 && length >> (8 * prefix_size) != 0) {
+            NOEVENT_THROW(std::length_error("[noevent] - payload is too large for the length prefix."));
+        }
+        for (std::size_t i = prefix_size; i > 0; --i) {
+            frame.push_back(static_cast<char>((length >> (8 * (i - 1))) & 0xff));
+        }
+    }
+    frame.append(payload);
+    return std::make_shared<const std::string>(std::move(frame));
+}
+
+DelimiterCodec::DelimiterCodec(std::string delimiter) : delimiter_ { std::move(delimiter) }
+{
+    if (delimiter_.empty()) {
+        NOEVENT_THROW(std::invalid_argument("[noevent] - delimiter cannot be empty."));
+    }
+}
+
+std::size_t DelimiterCodec::Decode(std::string_view input, std::string_view& payload,
+    DecodeState& state) const
+{
+    // Resume from where the last search stopped, a partial delimiter may be there.
+    std::size_t pos = std::min(state.scanned, input.size());
+    while (true) {
+        // `memchr` is vectorized by libc, which is faster than any naive search here.
+        const void* found = std::memchr(input.data() + pos, delimiter_.front(), input.size() - pos);
+        if (found == nullptr) {
+            state.scanned = input.size();
+            return 0;
+        }
+        pos = static_cast<const char*>(found) - input.data();
+        if (input.size() - pos < delimiter_.size()) {
+            state.scanned = pos;
+            return 0;
+        }
+        if (input.compare(pos, delimiter_.size(), delimiter_) == 0) {
+            break;
+        }
+        pos++;
+    }
+    payload = input.substr(0, pos);
+    return pos + delimiter_.size();
+}
+
+std::shared_ptr<const std::string> DelimiterCodec::Encode(std::string_view payload) const
+{
+    std::string frame;
+    frame.reserve(payload.size() + delimiter_.size());
+    frame.append(payload).append(delimiter_);
+    return std::make_shared<const std::string>(std::move(frame));
+}
+
+
+FrameReader::FrameReader(std::shared_ptr<const Codec> codec, std::size_t max_frame_size) :
+    codec_ { std::move(codec) }, max_frame_size_ { max_frame_size }
+{
+    if (codec_ == nullptr) {
+        NOEVENT_THROW(std::invalid_argument("[noevent] - codec cannot be nullptr."));
+    }
+}
+
+int FrameReader::ReadFrom(int fd, const FrameCallback& on_frame)
+{
+    constexpr std::size_t kMinReadSize { 4096 };
+
+    // Make room for the rest of a known frame, so it can be read at once.
+    std::size_t wanted = std::min(state_.frame_size, max_frame_size_);
+    wanted = wanted > Buffered() ? wanted - Buffered() : 0;
+    Reserve(std::max(kMinReadSize, wanted));
+
+    ssize_t len = read(fd, buffer_.get() + end_, capacity_ - end_);
+    if (len == 0) {
+        return 0;
+    }
+    if (len < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? -1 : errno;
+    }
+    end_ += len;
+
+    // The frame callback may close the connection and destroy its event.
+    bool has_event = EV_HUB.HasEvent(fd);
+    while (begin_ < end_) {
+        std::string_view payload;
+        std::size_t frame_size = codec_->Decode(
+            std::string_view(buffer_.get() + begin_, end_ - begin_), payload, state_);
+        if (frame_size == Codec::kMalformed) {
+            return EBADMSG;
+        }
+        if (frame_size == 0) {
+            if (state_.frame_size > max_frame_size_ || state_.scanned > max_frame_size_) {
+                return EMSGSIZE;
+            }
+            break;
+        }
+        if (frame_size > max_frame_size_) {
+            return EMSGSIZE;
+        }
+        begin_ += frame_size;
+        state_ = DecodeState {};
+        on_frame(fd, payload);
+        if (has_event && !EV_HUB.HasEvent(fd)) {
+            // Frames left are dropped along with the event.
+            begin_ = end_ = 0;
+            break;
+        }
+    }
+
+    if (begin_ == end_) {
+        begin_ = end_ = 0;
+        if (capacity_ > 4 * kMinReadSize) {
+            // Do not hold a large buffer for an idle fd.
+            buffer_.reset();
+            capacity_ = 0;
+        }
+    }
+    return -1;
+}
+
+void FrameReader::Reserve(std::size_t size)
+{
+    if (capacity_ - end_ >= size) {
+        return;
+    }
+    std::size_t buffered = Buffered();
+    if (capacity_ - buffered >= size) {
+        // Only the partial frame is moved to the front.
+        std::memmove(buffer_.get(), buffer_.get() + begin_, buffered);
+    } else {
+        // The buffer is not value-initialized since it is going to be overwritten.
+        std::size_t new_capacity = std::max(capacity_ * 2, buffered + size);
+        std::unique_ptr<char[]> new_buffer { new char[new_capacity] };
+        if (buffered != 0) {
+            std::memcpy(new_buffer.get(), buffer_.get() + begin_, buffered);
+        }
+        buffer_ = std::move(new_buffer);
+        capacity_ = new_capacity;
+    }
+    begin_ = 0;
+    end_ = buffered;
+}
+
+
+namespace
+{
+
+struct Attachment
+{
+    std::shared_ptr<FrameReader> reader_;
+    FrameReader::FrameCallback on_frame_;
+    FrameReader::CloseCallback on_close_;
+    std::optional<std::chrono::seconds> timeout_period_;
+};
+
+void ArmAttachment(int fd, std::shared_ptr<Attachment> attachment)
+{
+    // Only the attachment is captured, so re-arming does not copy the callbacks.
+    EV_HUB.SetCurrent(fd).OnRead([attachment](int fd, Event::Type, std::shared_ptr<void>) {
+        if (int reason = attachment->reader_->ReadFrom(fd, attachment->on_frame_); reason != -1) {
+            attachment->on_close_(fd, reason);
+            return;
+        }
+        if (!EV_HUB.HasEvent(fd)) {
+            // It is closed by the frame callback.
+            return;
+        }
+        ArmAttachment(fd, attachment);
+    }).Ready(attachment->timeout_period_);
+}
+
+}  // namespace
+
+
+void Attach(int fd, std::shared_ptr<FrameReader> reader, FrameReader::FrameCallback on_frame,
+    FrameReader::CloseCallback on_close, std::optional<std::chrono::seconds> timeout_period)
+{
+    if (reader == nullptr || on_frame == nullptr || on_close == nullptr) {
+        NOEVENT_THROW(std::invalid_argument("[noevent] - reader and callbacks cannot be nullptr."));
+    }
+    ArmAttachment(fd, std::make_shared<Attachment>(
+        Attachment { std::move(reader), std::move(on_frame), std::move(on_close), timeout_period }));
+}
+
+
+}  // namespace noevent::codec
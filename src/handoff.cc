@@ -0,0 +1,307 @@
+#include "noevent_handoff.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace noevent::handoff
+{
+
+namespace
+{
+
+// A record is sent as a fixed-size header carrying the fd, followed by the state and the
+// unsent bytes. Both processes run on the same host, so integers are in native order.
+constexpr std::uint32_t kMagic { 0x6e6f6576 };  // "noev"
+constexpr std::size_t kHeaderSize { 4 + 1 + 8 + 4 + 4 };
+
+enum Flag : std::uint8_t
+{
+    kReadEnabled = 1 << 0,
+    kWriteEnabled = 1 << 1,
+    kListener = 1 << 2,
+    kTimeout = 1 << 3,
+    kEnd = 1 << 4,  // no more records, and no fd is carried
+};
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags { MSG_NOSIGNAL };
+#else
+constexpr int kSendFlags { 0 };
+#endif
+
+struct Header
+{
+    std::uint8_t flags { 0 };
+    std::int64_t timeout_ms { 0 };
+    std::uint32_t state_size { 0 };
+    std::uint32_t output_size { 0 };
+};
+
+void EncodeHeader(const Header& header, char* buffer)
+{
+    std::memcpy(buffer, &kMagic, 4);
+    std::memcpy(buffer + 4, &header.flags, 1);
+    std::memcpy(buffer + 5, &header.timeout_ms, 8);
+    std::memcpy(buffer + 13, &header.state_size, 4);
+    std::memcpy(buffer + 17, &header.output_size, 4);
+}
+
+bool DecodeHeader(const char* buffer, Header& header)
+{
+    std::uint32_t magic;
+    std::memcpy(&magic, buffer, 4);
+    std::memcpy(&header.flags, buffer + 4, 1);
+    std::memcpy(&header.timeout_ms, buffer + 5, 8);
+    std::memcpy(&header.state_size, buffer + 13, 4);
+    std::memcpy(&header.output_size, buffer + 17, 4);
+    return magic == kMagic;
+}
+
+bool SockaddrOf(const std::string& path, sockaddr_un& addr)
+{
+    addr = sockaddr_un {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+int SendAll(int sock, const char* data, std::size_t size)
+{
+    while (size > 0) {
+        ssize_t len = send(sock, data, size, kSendFlags);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        data += len;
+        size -= len;
+    }
+    return 0;
+}
+
+int ReceiveAll(int sock, char* data, std::size_t size)
+{
+    while (size > 0) {
+        ssize_t len = recv(sock, data, size, 0);
+        if (len == 0) {
+            return ECONNRESET;
+        }
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        data += len;
+        size -= len;
+    }
+    return 0;
+}
+
+// The fd is attached to the header, so it arrives with the first byte of the record.
+int SendHeader(int sock, const Header& header, int fd)
+{
+    char buffer[kHeaderSize];
+    EncodeHeader(header, buffer);
+    iovec iov { buffer, kHeaderSize };
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+    if (fd != -1) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ssize_t len;
+    do {
+        len = sendmsg(sock, &msg, kSendFlags);
+    } while (len < 0 && errno == EINTR);
+    if (len < 0) {
+        return errno;
+    }
+    return SendAll(sock, buffer + len, kHeaderSize - len);
+}
+
+int ReceiveHeader(int sock, Header& header, int& fd)
+{
+    char buffer[kHeaderSize];
+    iovec iov { buffer, kHeaderSize };
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    fd = -1;
+    ssize_t len;
+    do {
+        len = recvmsg(sock, &msg, 0);
+    } while (len < 0 && errno == EINTR);
+    if (len <= 0) {
+        return len == 0 ? ECONNRESET : errno;
+    }
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (int error = ReceiveAll(sock, buffer + len, kHeaderSize - len); error != 0) {
+        return error;
+    }
+    return DecodeHeader(buffer, header) ? 0 : EPROTO;
+}
+
+int TransferEvents(int sock, const StateCallback& get_state)
+{
+    for (int fd : EV_HUB.GetFds()) {
+        Header header;
+        header.flags |= EV_HUB.IsReadEnabled(fd) ? kReadEnabled : 0;
+        header.flags |= EV_HUB.IsWriteEnabled(fd) ? kWriteEnabled : 0;
+        header.flags |= EV_HUB.IsListener(fd) ? kListener : 0;
+        if (auto remaining_timeout = EV_HUB.GetRemainingTimeout(fd); remaining_timeout.has_value()) {
+            header.flags |= kTimeout;
+            header.timeout_ms = remaining_timeout->count();
+        }
+        std::string state = get_state != nullptr ? get_state(fd) : std::string {};
+        std::string output = EV_HUB.TakePendingOutput(fd);
+        header.state_size = state.size();
+        header.output_size = output.size();
+
+        if (int error = SendHeader(sock, header, fd); error != 0) {
+            return error;
+        }
+        if (int error = SendAll(sock, state.data(), state.size()); error != 0) {
+            return error;
+        }
+        if (int error = SendAll(sock, output.data(), output.size()); error != 0) {
+            return error;
+        }
+    }
+    Header end;
+    end.flags = kEnd;
+    return SendHeader(sock, end, -1);
+}
+
+int ReceiveEvents(int sock, const AdoptCallback& adopt)
+{
+    while (true) {
+        Header header;
+        Record record;
+        if (int error = ReceiveHeader(sock, header, record.fd); error != 0) {
+            if (record.fd != -1) {
+                close(record.fd);
+            }
+            return error;
+        }
+        if (header.flags & kEnd) {
+            return 0;
+        }
+        if (record.fd == -1) {
+            return EPROTO;
+        }
+
+        std::string output(header.output_size, '\0');
+        record.state.resize(header.state_size);
+        if (int error = ReceiveAll(sock, record.state.data(), record.state.size());
+            error != 0 || (error = ReceiveAll(sock, output.data(), output.size())) != 0) {
+            close(record.fd);
+            return error;
+        }
+        record.read_enabled = header.flags & kReadEnabled;
+        record.write_enabled = header.flags & kWriteEnabled;
+        record.is_listener = header.flags & kListener;
+        if (header.flags & kTimeout) {
+            record.remaining_timeout = std::chrono::milliseconds { header.timeout_ms };
+        }
+
+        adopt(record);
+        if (!output.empty() && EV_HUB.HasEvent(record.fd)) {
+            EV_HUB.Write(record.fd, output);
+        }
+    }
+}
+
+}  // namespace
+
+
+int Transfer(const std::string& path, const StateCallback& get_state)
+{
+    sockaddr_un addr;
+    if (!SockaddrOf(path, addr)) {
+        return ENAMETOOLONG;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        return errno;
+    }
+    if (connect(sock, (sockaddr*)&addr, sizeof(addr))) {
+        int reason = errno;
+        close(sock);
+        return reason;
+    }
+
+    int error = TransferEvents(sock, get_state);
+    close(sock);
+    return error;
+}
+
+int Receive(const std::string& path, const AdoptCallback& adopt)
+{
+    if (adopt == nullptr) {
+        NOEVENT_THROW(std::invalid_argument("[noevent] - adopt callback cannot be nullptr."));
+    }
+    sockaddr_un addr;
+    if (!SockaddrOf(path, addr)) {
+        return ENAMETOOLONG;
+    }
+    int listen_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_sock == -1) {
+        return errno;
+    }
+    // A stale socket file left by a former hand-off would fail `bind()`.
+    unlink(path.c_str());
+    if (bind(listen_sock, (sockaddr*)&addr, sizeof(addr)) || listen(listen_sock, 1)) {
+        int reason = errno;
+        close(listen_sock);
+        return reason;
+    }
+
+    int sock;
+    do {
+        sock = accept(listen_sock, nullptr, nullptr);
+    } while (sock == -1 && errno == EINTR);
+    int error = sock == -1 ? errno : 0;
+    close(listen_sock);
+    unlink(path.c_str());
+    if (error != 0) {
+        return error;
+    }
+
+    error = ReceiveEvents(sock, adopt);
+    close(sock);
+    return error;
+}
+
+
+}  // namespace noevent::handoff
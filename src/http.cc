@@ -0,0 +1,362 @@
+#include "noevent_http.h"
+
+#include <stdexcept>
+#include <charconv>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+
+namespace noevent::http
+{
+
+namespace utils
+{
+
+const char* FindLineEnd(const char* begin, const char* end)
+{
+#ifdef __AVX2__
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    while (end - begin >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(chunk, cr), _mm256_cmpeq_epi8(chunk, lf)));
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+        begin += 32;
+    }
+#endif
+#ifdef __SSE4_2__
+    const __m128i eol = _mm_setr_epi8('\r', '\n', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while (end - begin >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        int index = _mm_cmpestri(eol, 2, chunk, 16,
+            _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index != 16) {
+            return begin + index;
+        }
+        begin += 16;
+    }
+#endif
+    while (begin != end && *begin != '\r' && *begin != '\n') {
+        ++begin;
+    }
+    return begin;
+}
+
+bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs)
+{
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < lhs.size(); ++i) {
+        // Only letters are folded, which is enough for header names.
+        if ((lhs[i] | 0x20) != (rhs[i] | 0x20)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace noevent::http::utils
+
+
+std::string_view Request::GetHeader(std::string_view name) const
+{
+    for (int i = 0; i < header_count; ++i) {
+        if (utils::EqualsIgnoreCase(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return {};
+}
+
+int ParseRequest(std::string_view input, Request& request)
+{
+    const char* begin = input.data();
+    const char* end = begin + input.size();
+    const char* cursor = begin;
+
+    // Returns 1 if a line is found, 0 if the input is incomplete, or -1 if it is malformed.
+    auto next_line = [&cursor, end](std::string_view& line) -> int {
+        const char* eol = utils::FindLineEnd(cursor, end);
+        if (eol == end) {
+            return 0;
+        }
+        line = std::string_view(cursor, eol - cursor);
+        if (*eol == '\r') {
+            if (eol + 1 == end) {
+                return 0;
+            }
+            if (eol[1] != '\n') {
+                return -1;
+            }
+            ++eol;
+        }
+        cursor = eol + 1;
+        return 1;
+    };
+    auto trim = [](std::string_view sv) -> std::string_view {
+        while (!sv.empty() && (sv.front() == ' ' || sv.front() == '\t')) {
+            sv.remove_prefix(1);
+        }
+        while (!sv.empty() && (sv.back() == ' ' || sv.back() == '\t')) {
+            sv.remove_suffix(1);
+        }
+        return sv;
+    };
+
+    // Request line, empty lines before it should be ignored.
+    std::string_view line;
+    do {
+        if (int ret = next_line(line); ret <= 0) {
+            return ret;
+        }
+    } while (line.empty());
+
+    auto method_end = line.find(' ');
+    auto target_end = line.rfind(' ');
+    if (method_end == std::string_view::npos || method_end == 0 || target_end == method_end) {
+        return -1;
+    }
+    request.method = line.substr(0, method_end);
+    request.target = line.substr(method_end + 1, target_end - method_end - 1);
+    auto version = line.substr(target_end + 1);
+    if (request.target.empty() || version.size() != 8 || version.substr(0, 7) != "HTTP/1." ||
+        (version[7] != '0' && version[7] != '1')) {
+        return -1;
+    }
+    request.minor_version = version[7] - '0';
+
+    // Headers, which end with an empty line.
+    request.header_count = 0;
+    while (true) {
+        if (int ret = next_line(line); ret <= 0) {
+            return ret;
+        }
+        if (line.empty()) {
+            break;
+        }
+        auto colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0 ||
+            request.header_count == Request::kMaxHeaders) {
+            return -1;
+        }
+        auto& header = request.headers[request.header_count++];
+        header.name = line.substr(0, colon);
+        header.value = trim(line.substr(colon + 1));
+        if (header.name.find_first_of(" \t") != std::string_view::npos) {
+            return -1;
+        }
+    }
+
+    auto connection = request.GetHeader("Connection");
+    if (request.minor_version == 1) {
+        request.keep_alive = !utils::EqualsIgnoreCase(connection, "close");
+    } else {
+        request.keep_alive = utils::EqualsIgnoreCase(connection, "keep-alive");
+    }
+
+    // Body.
+    if (!request.GetHeader("Transfer-Encoding").empty()) {
+        return -1;
+    }
+    std::size_t content_length = 0;
+    if (auto value = request.GetHeader("Content-Length"); !value.empty()) {
+        auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), content_length);
+        if (ec != std::errc() || ptr != value.data() + value.size()) {
+            return -1;
+        }
+    }
+    if (static_cast<std::size_t>(end - cursor) < content_length) {
+        return 0;
+    }
+    request.body = std::string_view(cursor, content_length);
+    cursor += content_length;
+
+    return cursor - begin;
+}
+
+
+void Server::Listen(std::uint16_t port, int backlog)
+{
+    if (listen_fd_ != -1) {
+        NOEVENT_THROW(std::logic_error("[noevent] - server is already listening."));
+    }
+
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ == -1) {
+        NOEVENT_THROW(std::runtime_error("[noevent] - failed to create socket."));
+    }
+    int reuse = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) || listen(listen_fd_, backlog)) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        NOEVENT_THROW(std::runtime_error("[noevent] - failed to listen."));
+    }
+    fcntl(listen_fd_, F_SETFL, fcntl(listen_fd_, F_GETFL) | O_NONBLOCK);
+
+    EV_HUB.CreateEmpty(listen_fd_, [](int, Event::Type, std::shared_ptr<void>) {})
+        .OnRead([this](int fd, Event::Type, std::shared_ptr<void>) { OnAccept(fd); }).AsListener().Ready();
+}
+
+void Server::OnAccept(int fd)
+{
+    while (true) {
+        int conn_fd = accept(fd, nullptr, nullptr);
+        if (conn_fd == -1) {
+            break;
+        }
+        // Responses are flushed by the hub, which should never block the loop.
+        fcntl(conn_fd, F_SETFL, fcntl(conn_fd, F_GETFL) | O_NONBLOCK);
+
+        auto conn = std::make_shared<Connection>();
+        EV_HUB.CreateEmpty(conn_fd, [this](int fd, Event::Type, std::shared_ptr<void>) {
+                // Both timeout and error close the connection.
+                Close(fd);
+            })
+            .WithData(conn)
+            .OnRead([this](int fd, Event::Type, std::shared_ptr<void> data) {
+                OnReadable(fd, std::static_pointer_cast<Connection>(data));
+            })
+            .Ready(idle_timeout_);
+    }
+
+    EV_HUB.SetCurrent(fd)
+        .OnRead([this](int fd, Event::Type, std::shared_ptr<void>) { OnAccept(fd); }).AsListener().Ready();
+}
+
+void Server::OnReadable(int fd, std::shared_ptr<Connection> conn)
+{
+    constexpr std::size_t kChunkSize { 16 * 1024 };
+
+    char chunk[kChunkSize];
+    ssize_t len = read(fd, chunk, kChunkSize);
+    if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+        Close(fd);
+        return;
+    }
+
+    // Requests are parsed in place if there is nothing left by the last read, which
+    // is the common case. Otherwise the chunk is appended to the partial one.
+    std::string_view input(chunk, len > 0 ? len : 0);
+    if (!conn->buffer_.empty()) {
+        conn->buffer_.append(input);
+        input = conn->buffer_;
+    }
+
+    // All complete requests in this batch are handled, which supports pipelining.
+    std::size_t consumed = 0;
+    while (consumed < input.size()) {
+        Request request;
+        int request_len = ParseRequest(input.substr(consumed), request);
+        if (request_len == 0) {
+            break;
+        }
+        if (request_len < 0) {
+            Response response { .status = 400, .reason = "Bad Request", .headers = {}, .body = {} };
+            request.keep_alive = false;
+            Reply(fd, request, response);
+            conn->is_closing = true;
+            break;
+        }
+        consumed += request_len;
+
+        Response response;
+        handler_(request, response);
+        Reply(fd, request, response);
+        if (!request.keep_alive) {
+            conn->is_closing = true;
+            break;
+        }
+    }
+
+    if (conn->is_closing) {
+        conn->buffer_.clear();
+    } else if (conn->buffer_.empty()) {
+        conn->buffer_.assign(input.substr(consumed));
+    } else {
+        conn->buffer_.erase(0, consumed);
+    }
+    if (conn->buffer_.size() > max_request_size_) {
+        Request request;
+        request.keep_alive = false;
+        Response response { .status = 413, .reason = "Content Too Large", .headers = {}, .body = {} };
+        Reply(fd, request, response);
+        conn->buffer_.clear();
+        conn->is_closing = true;
+    }
+
+    if (conn->is_closing) {
+        // Close the connection once the responses have been flushed.
+        EV_HUB.SetCurrent(fd).OnWrite([this](int fd, Event::Type, std::shared_ptr<void>) {
+            OnFlushed(fd);
+        }).Ready(idle_timeout_);
+        return;
+    }
+    EV_HUB.SetCurrent(fd).OnRead([this](int fd, Event::Type, std::shared_ptr<void> data) {
+        OnReadable(fd, std::static_pointer_cast<Connection>(data));
+    }).Ready(idle_timeout_);
+}
+
+void Server::OnFlushed(int fd)
+{
+    if (EV_HUB.HasPendingOutput(fd)) {
+        EV_HUB.SetCurrent(fd).OnWrite([this](int fd, Event::Type, std::shared_ptr<void>) {
+            OnFlushed(fd);
+        }).Ready(idle_timeout_);
+        return;
+    }
+    Close(fd);
+}
+
+void Server::Reply(int fd, const Request& request, Response& response)
+{
+    constexpr std::size_t kMaxInlineBody { 4096 };
+
+    std::string head;
+    head.reserve(128 + response.body.size() * (response.body.size() <= kMaxInlineBody));
+    head.append("HTTP/1.1 ").append(std::to_string(response.status))
+        .append(" ").append(response.reason).append("\r\n");
+    for (const auto& [name, value] : response.headers) {
+        head.append(name).append(": ").append(value).append("\r\n");
+    }
+    head.append("Content-Length: ").append(std::to_string(response.body.size())).append("\r\n");
+    if (!request.keep_alive) {
+        head.append("Connection: close\r\n");
+    }
+    head.append("\r\n");
+
+    // A small body is inlined, while a large one is sent as another payload and
+    // both of them are written by one `writev`.
+    if (response.body.size() <= kMaxInlineBody) {
+        head.append(response.body);
+        EV_HUB.Send(fd, std::make_shared<const std::string>(std::move(head)));
+        return;
+    }
+    EV_HUB.Send(fd, std::make_shared<const std::string>(std::move(head)));
+    EV_HUB.Send(fd, std::make_shared<const std::string>(std::move(response.body)));
+}
+
+void Server::Close(int fd)
+{
+    EV_HUB.SetCurrent(fd).Destroy();
+    close(fd);
+}
+
+
+}  // namespace noevent::http
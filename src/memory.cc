@@ -0,0 +1,194 @@
+#include "noevent.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+
+
+namespace noevent::internal
+{
+
+namespace
+{
+
+constexpr std::uint8_t kReadBit { 1 << 0 };
+constexpr std::uint8_t kWriteBit { 1 << 1 };
+constexpr std::uint8_t kErrorBit { 1 << 2 };
+
+std::uint8_t BitOf(MemoryEventOperation::Readiness readiness)
+{
+    switch (readiness) {
+    case MemoryEventOperation::Readiness::kRead:
+        return kReadBit;
+    case MemoryEventOperation::Readiness::kWrite:
+        return kWriteBit;
+    default:
+        return kErrorBit;
+    }
+}
+
+}  // namespace
+
+
+int MemoryEventOperation::Add(int fd) noexcept
+{
+    if (!interests_.emplace(fd, InterestOf(fd)).second) {
+        return EEXIST;
+    }
+    return 0;
+}
+
+int MemoryEventOperation::Del(int fd) noexcept
+{
+    return interests_.erase(fd) == 0 ? ENOENT : 0;
+}
+
+int MemoryEventOperation::Mod(int fd) noexcept
+{
+    auto it = interests_.find(fd);
+    if (it == interests_.end()) {
+        return ENOENT;
+    }
+    it->second = InterestOf(fd);
+    return 0;
+}
+
+int MemoryEventOperation::Poll(std::chrono::milliseconds waitting_time) noexcept
+{
+    poll_count_++;
+    while (true) {
+        for (; next_entry_ < trace_.size() && start_stamp_ + trace_[next_entry_].at <= now_; ++next_entry_) {
+            pending_[trace_[next_entry_].fd] |= BitOf(trace_[next_entry_].readiness);
+        }
+
+        bool has_delivered = false;
+        for (auto it = pending_.begin(); it != pending_.end(); ) {
+            auto interest = interests_.find(it->first);
+            if (interest == interests_.end() || (it->second & (interest->second | kErrorBit)) == 0) {
+                ++it;
+                continue;
+            }
+            const auto& current_ev = EV_HUB.FindEvent(it->first);
+            if (it->second & kErrorBit) {
+                current_ev->error_ = ECONNRESET;
+                current_ev->result_.set((int)Event::Type::kError, true);
+            } else {
+                if (it->second & interest->second & kReadBit) {
+                    current_ev->result_.set((int)Event::Type::kRead, true);
+                }
+                if (it->second & interest->second & kWriteBit) {
+                    current_ev->result_.set((int)Event::Type::kWrite, true);
+                }
+            }
+            // Delivered readiness is consumed, as if callbacks drained the fd.
+            it->second &= ~(interest->second | kErrorBit);
+            if (!current_ev->where_.test((int)Event::Where::kInActive)) {
+                EV_HUB.ActivePush(current_ev->fd_);
+            }
+            it = it->second == 0 ? pending_.erase(it) : std::next(it);
+            has_delivered = true;
+        }
+        if (has_delivered || !EV_HUB.active_fds_.empty()) {
+            return 0;
+        }
+
+        // Nothing happens until the next readiness or wakeup, so jump there directly.
+        // A blocking wait without either of them would never return, it returns instead.
+        auto next_stamp = EV_HUB.CalculateWakeupStamp();
+        if (waitting_time > std::chrono::milliseconds::zero()) {
+            next_stamp = std::min(next_stamp, now_ + waitting_time);
+        }
+        if (next_entry_ < trace_.size()) {
+            next_stamp = std::min(next_stamp, start_stamp_ + trace_[next_entry_].at);
+        }
+        if (next_stamp == std::chrono::time_point<std::chrono::system_clock>::max()) {
+            return 0;
+        }
+        now_ = std::max(now_, next_stamp);
+        if (next_entry_ == trace_.size() || start_stamp_ + trace_[next_entry_].at > now_) {
+            // It is a wakeup of the hub rather than readiness.
+            return 0;
+        }
+    }
+}
+
+void MemoryEventOperation::Replay(std::vector<TraceEntry> trace)
+{
+    // Stable, so entries at the same time keep their order.
+    std::stable_sort(trace.begin(), trace.end(),
+        [](const TraceEntry& lhs, const TraceEntry& rhs) { return lhs.at < rhs.at; });
+    std::vector<TraceEntry> merged;
+    merged.reserve(trace_.size() - next_entry_ + trace.size());
+    std::merge(trace_.begin() + next_entry_, trace_.end(), trace.begin(), trace.end(),
+        std::back_inserter(merged),
+        [](const TraceEntry& lhs, const TraceEntry& rhs) { return lhs.at < rhs.at; });
+    trace_ = std::move(merged);
+    next_entry_ = 0;
+}
+
+std::vector<MemoryEventOperation::TraceEntry> MemoryEventOperation::ParseTrace(std::string_view text)
+{
+    std::vector<TraceEntry> trace;
+    while (!text.empty()) {
+        auto line = text.substr(0, text.find('\n'));
+        text.remove_prefix(std::min(text.size(), line.size() + 1));
+
+        std::int64_t at;
+        int fd;
+        const char* end = line.data() + line.size();
+        auto [at_end, at_error] = std::from_chars(line.data(), end, at);
+        if (at_error != std::errc {} || at_end == end || *at_end != ' ') {
+            continue;
+        }
+        auto [fd_end, fd_error] = std::from_chars(at_end + 1, end, fd);
+        if (fd_error != std::errc {} || end - fd_end < 2 || *fd_end != ' ') {
+            continue;
+        }
+        switch (fd_end[1]) {
+        case 'r':
+            trace.push_back({ std::chrono::microseconds { at }, fd, Readiness::kRead });
+            break;
+        case 'w':
+            trace.push_back({ std::chrono::microseconds { at }, fd, Readiness::kWrite });
+            break;
+        case 'e':
+            trace.push_back({ std::chrono::microseconds { at }, fd, Readiness::kError });
+            break;
+        default:
+            break;
+        }
+    }
+    return trace;
+}
+
+bool MemoryEventOperation::IsDrained() const
+{
+    if (next_entry_ != trace_.size()) {
+        return false;
+    }
+    return std::none_of(pending_.begin(), pending_.end(), [this](const auto& pending) {
+        auto interest = interests_.find(pending.first);
+        return interest != interests_.end() && (pending.second & (interest->second | kErrorBit)) != 0;
+    });
+}
+
+std::uint8_t MemoryEventOperation::InterestOf(int fd) const noexcept
+{
+    const auto& current_ev = EV_HUB.FindEvent(fd);
+    std::uint8_t interest = 0;
+    if (current_ev->WantsWrite()) {
+        interest |= kWriteBit;
+    }
+    if (current_ev->WantsRead()) {
+        interest |= kReadBit;
+    }
+    return interest;
+}
+
+void MemoryEventOperation::Inject(int fd, Readiness readiness)
+{
+    pending_[fd] |= BitOf(readiness);
+}
+
+
+}  // namespace noevent::internal
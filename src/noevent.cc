@@ -3,9 +3,17 @@
 #include <stdexcept>
 #include <cassert>
 #include <algorithm>
+#include <limits>
+#include <cerrno>
 
 #include <iostream>
 
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+
 
 #ifdef DEBUG
 #include <iostream>
@@ -23,16 +31,16 @@ void EventMinHeap::Push(int fd)
 {
     data_.push_back(fd);
     std::push_heap(data_.begin(), data_.end(), [](int lhs, int rhs) -> bool {
-        return EV_HUB.events.at(lhs)->timeout_stamp_ >
-            EV_HUB.events.at(rhs)->timeout_stamp_;
+        return EV_HUB.FindEvent(lhs)->timeout_stamp_ >
+            EV_HUB.FindEvent(rhs)->timeout_stamp_;
     });
 }
 
 void EventMinHeap::Pop()
 {
     std::pop_heap(data_.begin(), data_.end(), [](int lhs, int rhs) -> bool {
-        return EV_HUB.events.at(lhs)->timeout_stamp_ >
-            EV_HUB.events.at(rhs)->timeout_stamp_;
+        return EV_HUB.FindEvent(lhs)->timeout_stamp_ >
+            EV_HUB.FindEvent(rhs)->timeout_stamp_;
     });
     data_.pop_back();
 }
@@ -42,12 +50,104 @@ void EventMinHeap::Remove(int fd)
     if (auto it = std::find(data_.begin(), data_.end(), fd); it != data_.end()) {
         data_.erase(it);
         std::make_heap(data_.begin(), data_.end(), [](int lhs, int rhs) -> bool {
-            return EV_HUB.events.at(lhs)->timeout_stamp_ >
-                EV_HUB.events.at(rhs)->timeout_stamp_;
+            return EV_HUB.FindEvent(lhs)->timeout_stamp_ >
+                EV_HUB.FindEvent(rhs)->timeout_stamp_;
         });
     }
 }
 
+TokenBucket::TokenBucket(std::int64_t rate, std::int64_t burst) :
+    rate_ { rate }, burst_ { burst }, tokens_ { burst },
+    refill_stamp_ { std::chrono::system_clock::now() }
+{
+    if (rate <= 0 || burst <= 0) {
+        NOEVENT_THROW(std::invalid_argument("[noevent] - rate and burst of token bucket must be positive."));
+    }
+}
+
+void TokenBucket::Refill(std::chrono::time_point<std::chrono::system_clock> now)
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - refill_stamp_);
+    // A long idle period would overflow the product, and it is long enough to refill
+    // any reasonable bucket anyway.
+    std::int64_t elapsed_us = std::min(elapsed.count(), std::numeric_limits<std::int64_t>::max() / rate_);
+    std::int64_t tokens = rate_ * elapsed_us / 1'000'000;
+    if (tokens <= 0) {
+        // Keep the stamp unchanged, otherwise a slow bucket would never be refilled
+        // since the fraction is dropped every time.
+        return;
+    }
+    tokens_ = std::min(burst_, tokens_ + tokens);
+    refill_stamp_ = now;
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept :
+    pool_ { other.pool_ }, data_ { std::move(other.data_) },
+    size_class_ { other.size_class_ }, size_ { other.size_ }
+{
+    other.size_ = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept
+{
+    if (this != &other) {
+        if (data_ != nullptr) {
+            pool_->Release(std::move(data_), size_class_);
+        }
+        pool_ = other.pool_;
+        data_ = std::move(other.data_);
+        size_class_ = other.size_class_;
+        size_ = other.size_;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+PooledBuffer::~PooledBuffer()
+{
+    if (data_ != nullptr) {
+        pool_->Release(std::move(data_), size_class_);
+    }
+}
+
+std::size_t PooledBuffer::Capacity() const
+{
+    return data_ == nullptr ? 0 : BufferPool::kMinClassSize << size_class_;
+}
+
+PooledBuffer BufferPool::Acquire(int size_class)
+{
+    PooledBuffer buffer;
+    buffer.pool_ = this;
+    buffer.size_class_ = std::clamp(size_class, 0, kClassCount - 1);
+    auto& free_list = free_lists_[buffer.size_class_];
+    if (free_list.empty()) {
+        // Not value-initialized since it is going to be overwritten.
+        buffer.data_.reset(new char[kMinClassSize << buffer.size_class_]);
+    } else {
+        buffer.data_ = std::move(free_list.back());
+        free_list.pop_back();
+    }
+    return buffer;
+}
+
+std::size_t BufferPool::FreeBytes() const
+{
+    std::size_t free_bytes = 0;
+    for (int i = 0; i < kClassCount; ++i) {
+        free_bytes += free_lists_[i].size() * (kMinClassSize << i);
+    }
+    return free_bytes;
+}
+
+void BufferPool::Release(std::unique_ptr<char[]> data, int size_class)
+{
+    // Buffers beyond the limit are freed, so a burst does not pin its memory forever.
+    if (free_lists_[size_class].size() < max_free_count_) {
+        free_lists_[size_class].push_back(std::move(data));
+    }
+}
+
 }  // namespace noevent::utils
 
 EventHub& EventHub::Instance()
@@ -59,20 +159,20 @@ EventHub& EventHub::Instance()
 EventHub& EventHub::CreateEmpty(int fd, Event::Callback error_cb)
 {
     if (fd < 0) {
-        throw std::invalid_argument("[noevent] - invalid file descriptor.");
+        NOEVENT_THROW(std::invalid_argument("[noevent] - invalid file descriptor."));
     }
     if (error_cb == nullptr) {
         // Now the error callback is necessary for an event and the error callback
         // cannot be changed once it is definite. Users can handle all possible errors
         // or exceptions during dispatch.
-        throw std::invalid_argument("[noevent] - error callback cannot be nullptr.");
+        NOEVENT_THROW(std::invalid_argument("[noevent] - error callback cannot be nullptr."));
     }
     if (events.contains(fd)) {
-        throw std::logic_error("[noevent] - file descriptor already exists.");
+        NOEVENT_THROW(std::logic_error("[noevent] - file descriptor already exists."));
     }
     auto event_ptr = std::make_shared<Event>(fd);
     if (event_ptr == nullptr) {
-        throw std::runtime_error("[noevent] - failed to create empty state.");
+        NOEVENT_THROW(std::runtime_error("[noevent] - failed to create empty state."));
     }
 
     event_ptr->error_cb_ = error_cb;
@@ -87,10 +187,10 @@ EventHub& EventHub::CreateEmpty(int fd, Event::Callback error_cb)
 EventHub& EventHub::SetCurrent(int fd)
 {
     if (fd < 0) {
-        throw std::invalid_argument("[noevent] - invalid file descriptor.");
+        NOEVENT_THROW(std::invalid_argument("[noevent] - invalid file descriptor."));
     }
     if (!events.contains(fd)) {
-        throw std::logic_error("[noevent] - file descriptor not exists.");
+        NOEVENT_THROW(std::logic_error("[noevent] - file descriptor not exists."));
     }
     if (events.at(fd)->is_locked) {
         // We only allow users to change non-active(unlocked) events. The main reasons are as follows.
@@ -100,8 +200,8 @@ EventHub& EventHub::SetCurrent(int fd)
         //    Users can handle the event later if it is still in active queue,
         //    which just indicates that its turn has not come yet.
         // 3. Prolong the time period of an active event due to timeout is resonable, but
-        //    this is worth a new method such as `Prolong()` instead of `Ready()`.
-        throw std::logic_error("[noevent] - trying to change a locked event is not allowed.");
+        //    this is worth a new method, which is `Prolong()` or `Touch()`, instead of `Ready()`.
+        NOEVENT_THROW(std::logic_error("[noevent] - trying to change a locked event is not allowed."));
     }
 
     current_fd_ = fd;
@@ -128,6 +228,75 @@ EventHub& EventHub::WithData(std::shared_ptr<void> data)
     return *this;
 }
 
+EventHub& EventHub::WithSlack(std::chrono::milliseconds timer_slack)
+{
+    if (timer_slack < std::chrono::milliseconds::zero()) {
+        NOEVENT_THROW(std::invalid_argument("[noevent] - timer slack cannot be negative."));
+    }
+    events.at(current_fd_)->timer_slack_ = timer_slack;
+    return *this;
+}
+
+EventHub& EventHub::LimitRead(std::shared_ptr<utils::TokenBucket> bucket,
+    std::shared_ptr<utils::TokenBucket> group)
+{
+    // Both of them could be `nullptr`, which means the read bandwidth is not limited.
+    const auto& current_ev = events.at(current_fd_);
+    current_ev->read_limits_[0] = bucket;
+    current_ev->read_limits_[1] = group;
+    return *this;
+}
+
+EventHub& EventHub::LimitWrite(std::shared_ptr<utils::TokenBucket> bucket,
+    std::shared_ptr<utils::TokenBucket> group)
+{
+    // Both of them could be `nullptr`, which means the write bandwidth is not limited.
+    const auto& current_ev = events.at(current_fd_);
+    current_ev->write_limits_[0] = bucket;
+    current_ev->write_limits_[1] = group;
+    return *this;
+}
+
+EventHub& EventHub::Optimistic(bool is_optimistic)
+{
+    // Worth it for events which are usually ready once armed, such as writing a reply or
+    // reading a connection just accepted.
+    const auto& current_ev = events.at(current_fd_);
+    current_ev->is_optimistic = is_optimistic;
+    current_ev->probe_backoff_ = current_ev->probe_skips_ = 0;
+    return *this;
+}
+
+EventHub& EventHub::AutoRead(bool is_auto_read)
+{
+    const auto& current_ev = events.at(current_fd_);
+    current_ev->is_auto_read = is_auto_read;
+    return *this;
+}
+
+EventHub& EventHub::Cork([[maybe_unused]] bool is_corked)
+{
+    // Writes of an iteration are coalesced by staging already, while corking holds partial
+    // segments across iterations, e.g. a response whose body is produced later. The kernel
+    // pushes them once uncorked or after 200ms. It takes no effect but on TCP sockets.
+    const auto& current_ev = events.at(current_fd_);
+#ifdef TCP_CORK
+    int option = is_corked;
+    setsockopt(current_ev->fd_, IPPROTO_TCP, TCP_CORK, &option, sizeof(option));
+#else
+    static_cast<void>(current_ev);
+#endif
+    return *this;
+}
+
+EventHub& EventHub::AsListener(bool is_listener)
+{
+    // Listeners are paused first once the hub is overloaded, since accepting more
+    // connections only makes it worse.
+    events.at(current_fd_)->is_listener = is_listener;
+    return *this;
+}
+
 bool EventHub::IsReadEnabled(int fd) const
 {
     return events.at(fd)->read_cb_ != nullptr;
@@ -145,7 +314,8 @@ bool EventHub::HasData(int fd) const
 
 bool EventHub::IsInTimeout(int fd) const
 {
-    return events.at(fd)->where_.test((int)Event::Where::kInTimeout);
+    const auto& current_ev = events.at(fd);
+    return current_ev->where_.test((int)Event::Where::kInTimeout) && !current_ev->is_timeout_stale;
 }
 
 bool EventHub::IsInReady(int fd) const
@@ -158,6 +328,58 @@ bool EventHub::IsInActive(int fd) const
     return events.at(fd)->where_.test((int)Event::Where::kInActive);
 }
 
+bool EventHub::IsInThrottled(int fd) const
+{
+    return events.at(fd)->where_.test((int)Event::Where::kInThrottled);
+}
+
+std::pair<std::uint64_t, std::uint64_t> EventHub::GetProbeStats(int fd) const
+{
+    const auto& current_ev = events.at(fd);
+    return { current_ev->probe_hits_, current_ev->probe_misses_ };
+}
+
+std::vector<int> EventHub::GetFds() const
+{
+    std::vector<int> fds;
+    fds.reserve(events.size());
+    for (const auto& [fd, _] : events) {
+        fds.push_back(fd);
+    }
+    return fds;
+}
+
+std::optional<std::chrono::milliseconds> EventHub::GetRemainingTimeout(int fd) const
+{
+    using namespace std::chrono_literals;
+
+    const auto& current_ev = events.at(fd);
+    if (!IsInTimeout(fd)) {
+        return std::nullopt;
+    }
+    // The real deadline is used, which may be later than the key in timeout heap.
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+        current_ev->deadline_stamp_ - Now());
+    return std::max(remaining, 0ms);
+}
+
+std::span<const char> EventHub::ReadBuffer(int fd) const
+{
+    const auto& read_buffer = events.at(fd)->read_buffer_;
+    return { read_buffer.Data(), read_buffer.Size() };
+}
+
+utils::PooledBuffer EventHub::TakeBuffer(int fd)
+{
+    return std::move(events.at(fd)->read_buffer_);
+}
+
+bool EventHub::HasPendingOutput(int fd) const
+{
+    const auto& current_ev = events.at(fd);
+    return !current_ev->outbox_.empty() || !current_ev->staging_.empty();
+}
+
 void EventHub::Ready(std::optional<std::chrono::seconds> timeout_period)
 {
     const auto& current_ev = events.at(current_fd_);
@@ -173,11 +395,8 @@ void EventHub::Ready(std::optional<std::chrono::seconds> timeout_period)
     }
 
     if (timeout_period.has_value()) {
-        if (IsInTimeout(current_ev->fd_)) {
-            TimeoutRemove(current_ev->fd_);
-        }
-        current_ev->timeout_stamp_ = std::chrono::system_clock::now() + timeout_period.value();
-        TimeoutPush(current_ev->fd_);
+        current_ev->timeout_period_ = timeout_period.value();
+        TimeoutSchedule(current_ev->fd_, Now() + timeout_period.value());
 #ifdef DEBUG
     std::cout << std::format("[noevent] - event({}) with timeout, TIMEOUT: #{}\n",
         current_ev->fd_, timeout_heap_.Size());
@@ -185,68 +404,259 @@ void EventHub::Ready(std::optional<std::chrono::seconds> timeout_period)
     }
 }
 
+void EventHub::Activate(int fd, Event::Type result)
+{
+    // The event goes to the active queue straightly and will be responsed in the next
+    // loop, so it costs no syscall unless it is registered, which costs one `Del()`.
+    const auto& current_ev = events.at(fd);
+    if ((result == Event::Type::kRead && current_ev->read_cb_ == nullptr) ||
+        (result == Event::Type::kWrite && current_ev->write_cb_ == nullptr)) {
+        NOEVENT_THROW(std::logic_error("[noevent] - event without the callback cannot be activated."));
+    }
+
+    current_ev->result_.set((int)result, true);
+    if (IsInActive(fd)) {
+        return;
+    }
+    if (IsInThrottled(fd)) {
+        // Users know it is ready, so it is not worth waiting for refilling.
+        ThrottledRemove(fd);
+    }
+    // It is skipped by preprocess if it is still in ready queue.
+    current_ev->is_locked = true;
+    ActivePush(fd);
+#ifdef DEBUG
+    std::cout << std::format("[noevent] - event({}) activated, ACTIVE: #{}\n",
+        current_ev->fd_, active_fds_.size());
+#endif
+}
+
+void EventHub::Prolong(int fd, std::chrono::seconds timeout_period)
+{
+    // Unlike `SetCurrent()`, a locked event can be prolonged since its callbacks are
+    // not touched. It is cheap enough to be invoked for every message, including in the
+    // callbacks of the event, which keeps the timeout responsed along with them.
+    const auto& current_ev = events.at(fd);
+    if (!IsInTimeout(fd) && !(current_ev->is_timeout_stale && current_ev->is_responsing)) {
+        NOEVENT_THROW(std::logic_error("[noevent] - event without timeout cannot be prolonged."));
+    }
+
+    current_ev->timeout_period_ = timeout_period;
+    TimeoutSchedule(fd, Now() + timeout_period);
+#ifdef DEBUG
+    std::cout << std::format("[noevent] - event({}) prolonged, TIMEOUT: #{}\n",
+        current_ev->fd_, timeout_heap_.Size());
+#endif
+}
+
+void EventHub::Touch(int fd)
+{
+    // Prolong the event with the latest time period given by `Ready()` or `Prolong()`.
+    Prolong(fd, events.at(fd)->timeout_period_);
+}
+
 void EventHub::Destroy()
 {
-    auto& current_ev = events.at(current_fd_);
+    const auto current_ev = events.at(current_fd_);
 
-    if (IsInReady(current_ev->fd_) || IsInTimeout(current_ev->fd_)) {
-        throw std::logic_error("[noevent] - event in ready or timeout cannot be destroyed.");
+    if (IsInReady(current_ev->fd_) || IsInTimeout(current_ev->fd_) ||
+        IsInThrottled(current_ev->fd_)) {
+        NOEVENT_THROW(std::logic_error("[noevent] - event in ready, timeout or throttled cannot be destroyed."));
+    }
+    if (current_ev->where_.test((int)Event::Where::kInTimeout)) {
+        // The stale entry refers to the event, so it cannot be left in timeout heap.
+        TimeoutRemove(current_ev->fd_);
+    }
+    if (current_ev->where_.test((int)Event::Where::kInDirty)) {
+        // Pending output is dropped with the event.
+        DirtyRemove(current_ev->fd_);
+    }
+    if (current_ev->where_.test((int)Event::Where::kInSystem)) {
+        // It is registered only for its pending output, which keeps it unlocked.
+        SystemDel(current_ev);
     }
 
+    current_ev->is_destroyed = true;
     events.erase(current_ev->fd_);
 #ifdef DEBUG
     std::cout << std::format("[noevent] - event({}) destroyed, EVENTS: #{}\n",
         current_ev->fd_, events.size());
 #endif
-    current_ev.reset();
 }
 
-void EventHub::LoopOnce(bool can_block)
+void EventHub::Consume(int fd, Event::Type type, std::int64_t tokens)
+{
+    const auto& current_ev = events.at(fd);
+
+    std::shared_ptr<utils::TokenBucket>* limits = nullptr;
+    switch (type)
+    {
+        case Event::Type::kRead:
+            limits = current_ev->read_limits_;
+            break;
+        case Event::Type::kWrite:
+            limits = current_ev->write_limits_;
+            break;
+        default:
+            NOEVENT_THROW(std::invalid_argument("[noevent] - only read or write can consume tokens."));
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (limits[i] != nullptr) {
+            limits[i]->Consume(tokens);
+        }
+    }
+}
+
+void EventHub::Write(int fd, std::string_view data, bool is_urgent)
+{
+    const auto& current_ev = events.at(fd);
+
+    // Unlike `Send()`, bytes are copied, so that writes of an iteration are coalesced
+    // into a single payload rather than a lot of tiny iovecs.
+    current_ev->staging_.append(data);
+    if (!current_ev->where_.test((int)Event::Where::kInDirty)) {
+        DirtyPush(fd);
+    }
+    if (is_urgent) {
+        // It stays dirty, since the kernel buffer may be full.
+        FlushOutbox(current_ev);
+    }
+}
+
+std::string EventHub::TakePendingOutput(int fd)
+{
+    const auto& current_ev = events.at(fd);
+
+    std::string pending_output;
+    SealStaging(current_ev);
+    for (const auto& payload : current_ev->outbox_) {
+        std::size_t offset = pending_output.empty() ? current_ev->outbox_offset_ : 0;
+        pending_output.append(*payload, offset);
+    }
+    current_ev->outbox_.clear();
+    current_ev->outbox_offset_ = 0;
+    return pending_output;
+}
+
+void EventHub::Send(int fd, std::shared_ptr<const std::string> payload)
+{
+    if (payload == nullptr || payload->empty()) {
+        return;
+    }
+    const auto& current_ev = events.at(fd);
+
+    SealStaging(current_ev);
+
+    // Payloads are not written immediately but flushed at the end of `LoopOnce()`,
+    // so that all payloads of an event are coalesced into a single `writev`.
+    current_ev->outbox_.push_back(std::move(payload));
+    if (!current_ev->where_.test((int)Event::Where::kInDirty)) {
+        DirtyPush(fd);
+    }
+}
+
+void EventHub::Broadcast(std::shared_ptr<const std::string> payload, std::span<const int> fds)
+{
+    // The payload is shared rather than copied for every event.
+    for (int fd : fds) {
+        Send(fd, payload);
+    }
+}
+
+void EventHub::SetTickPeriod(std::chrono::milliseconds tick_period)
+{
+    if (tick_period <= std::chrono::milliseconds::zero()) {
+        NOEVENT_THROW(std::invalid_argument("[noevent] - tick period must be positive."));
+    }
+    tick_period_ = tick_period;
+}
+
+void EventHub::SetTimerSlack(std::chrono::milliseconds timer_slack)
+{
+    // Timeouts never fire early, but may fire up to `timer_slack` late.
+    if (timer_slack < std::chrono::milliseconds::zero()) {
+        NOEVENT_THROW(std::invalid_argument("[noevent] - timer slack cannot be negative."));
+    }
+    timer_slack_ = timer_slack;
+}
+
+void EventHub::SetOverloadPolicy(std::optional<OverloadPolicy> policy)
+{
+    if (policy.has_value() && (policy->recovery_lag > policy->deprioritize_lag ||
+        policy->deprioritize_lag > policy->pause_accept_lag ||
+        policy->pause_accept_lag > policy->park_reads_lag)) {
+        NOEVENT_THROW(std::invalid_argument("[noevent] - thresholds of overload policy must be ascending."));
+    }
+    overload_policy_ = policy;
+    overload_level_ = OverloadLevel::kNone;
+}
+
+void EventHub::SetBackend(std::unique_ptr<internal::SystemEventOperation> sys_ev_op)
+{
+    if (!events.empty()) {
+        // Registered events cannot be moved to another backend.
+        NOEVENT_THROW(std::logic_error("[noevent] - backend can only be replaced without any event."));
+    }
+    replaced_ev_op_ = std::move(sys_ev_op);
+    tick_stamp_ = Now();
+}
+
+int EventHub::LoopOnce(bool can_block)
 {
     using namespace std::chrono_literals;
 
-    // Preprocess.
+    // Preprocess. Output sent out of callbacks is flushed before polling, which may
+    // block for a long time.
+    FlushDirtyEvents();
     PreprocessReadyEvents();
-    auto waitting_time = can_block ? CalculateWaittingTime() : 0s;
+    auto poll_stamp = Now();
+    auto waitting_time = can_block ? CalculateWaittingTime() : 0ms;
 #ifdef DEBUG
-    if (waitting_time != 0s) {
+    if (waitting_time != 0ms) {
         std::cout << std::format("[noevent] - waitting time: {}\n", waitting_time);
     }
 #endif
 
     // Events Detect.
-    sys_ev_op_->Poll(waitting_time);
+    int poll_error = BackendPoll(waitting_time);
+    if (poll_error == EINTR) {
+        poll_error = 0;
+    }
+#ifdef DEBUG
+    if (poll_error != 0) {
+        std::cout << std::format("[noevent] - failed to poll events: {}\n", poll_error);
+    }
+#endif
+    if (overload_policy_.has_value()) {
+        CheckOverload(std::min(poll_stamp + waitting_time, CalculateWakeupStamp()));
+    }
     CheckTimeoutEvents();
+    CheckThrottledEvents();
 
     // Response.
     ResponseActiveEvents();
-}
-
-EventHub::EventHub() :
-    sys_ev_op_
-    {
-#ifdef __APPLE__
-        std::make_unique<internal::KQueue>()
-#elif defined(__linux__)
-        std::make_unique<internal::Epoll>()
-#endif
-    }
-{
-    if (sys_ev_op_ == nullptr) {
-        throw std::runtime_error("[noevent] - failed to initialize system event operation.");
-    }
+    FlushDirtyEvents();
+    return poll_error;
 }
 
 void EventHub::PreprocessReadyEvents()
 {
     while (!ready_fds_.empty()) {
-        const auto& current_ev = events.at(ReadyFrontAndPop());
+        const auto& current_ev = FindEvent(ReadyFrontAndPop());
 
+        if (current_ev->where_.test((int)Event::Where::kInActive)) {
+            // It has been activated manually.
+            continue;
+        }
         if (current_ev->write_cb_ == nullptr && current_ev->read_cb_ == nullptr) {
             // Users can cancel the event before dispatch by clearing it's read/write callback(s).
-            if (IsInTimeout(current_ev->fd_)) {
+            if (current_ev->where_.test((int)Event::Where::kInTimeout)) {
                 TimeoutRemove(current_ev->fd_);
             }
+            if (!current_ev->outbox_.empty() && !current_ev->where_.test((int)Event::Where::kInDirty)) {
+                // Its pending output still waits for writability by itself.
+                DirtyPush(current_ev->fd_);
+            }
 #ifdef DEBUG
     std::cout << std::format("[noevent] - event({}) cancelled, READY: #{}, TIMEOUT: #{}\n",
         current_ev->fd_, ready_fds_.size(), timeout_heap_.Size());
@@ -255,54 +665,155 @@ void EventHub::PreprocessReadyEvents()
         }
 
         current_ev->is_locked = true;
-        try {
-            sys_ev_op_->Add(current_ev->fd_);
+        if (Park(current_ev)) {
+            // Parked directions will not be registered until their buckets are refilled
+            // by ticks, so the event still keeps its callbacks and timeout.
+            if (!current_ev->where_.test((int)Event::Where::kInThrottled)) {
+                ThrottledPush(current_ev->fd_);
+            }
 #ifdef DEBUG
-    std::cout << std::format("[noevent] - event({}) registered, READY: #{}, TIMEOUT: #{}\n",
-        current_ev->fd_, ready_fds_.size(), timeout_heap_.Size());
+    std::cout << std::format("[noevent] - event({}) throttled, READY: #{}, THROTTLED: #{}\n",
+        current_ev->fd_, ready_fds_.size(), throttled_fds_.size());
+#endif
+            if (!current_ev->WantsRead() && !current_ev->WantsWrite()) {
+                if (current_ev->where_.test((int)Event::Where::kInSystem)) {
+                    SystemDel(current_ev);
+                }
+                continue;
+            }
+            // The other direction or pending output is still registered.
+        }
+        if (current_ev->is_optimistic && Probe(current_ev)) {
+            // Ready already, so it is responsed without registering and polling. The
+            // probe may miss the writability of pending output, which is retried then.
+            ActivePush(current_ev->fd_);
+            KeepWritable(current_ev);
+#ifdef DEBUG
+    std::cout << std::format("[noevent] - event({}) probed, READY: #{}, ACTIVE: #{}\n",
+        current_ev->fd_, ready_fds_.size(), active_fds_.size());
 #endif
-        } catch (...) {
-            if (IsInTimeout(current_ev->fd_)) {
+            continue;
+        }
+        // It may have been registered for its pending output only.
+        if (int error = current_ev->where_.test((int)Event::Where::kInSystem) ?
+            BackendMod(current_ev->fd_) : BackendAdd(current_ev->fd_); error != 0) {
+            if (current_ev->where_.test((int)Event::Where::kInTimeout)) {
                 TimeoutRemove(current_ev->fd_);
             }
+            current_ev->error_ = error;
             current_ev->result_.reset().set((int)Event::Type::kError, true);
             ActivePush(current_ev->fd_);
 #ifdef DEBUG
     std::cout << std::format("[noevent] - event({}) on error, READY: #{}, TIMEOUT: #{}, ACTIVE: #{}\n",
         current_ev->fd_, ready_fds_.size(), timeout_heap_.Size(), active_fds_.size());
 #endif
+            continue;
         }
+        current_ev->where_.set((int)Event::Where::kInSystem, true);
+#ifdef DEBUG
+    std::cout << std::format("[noevent] - event({}) registered, READY: #{}, TIMEOUT: #{}\n",
+        current_ev->fd_, ready_fds_.size(), timeout_heap_.Size());
+#endif
+    }
+}
+
+std::chrono::time_point<std::chrono::system_clock> EventHub::CalculateWakeupStamp()
+{
+    auto wakeup_stamp = std::chrono::time_point<std::chrono::system_clock>::max();
+    if (!throttled_fds_.empty() || overload_policy_.has_value()) {
+        // Ticks also measure the loop lag once overload control is enabled.
+        wakeup_stamp = tick_stamp_ + tick_period_;
+    }
+    while (!fire_stamps_.empty()) {
+        auto [fire_stamp, fd] = fire_stamps_.top();
+        if (auto it = events.find(fd); it != events.end() &&
+            it->second->where_.test((int)Event::Where::kInTimeout) && it->second->fire_stamp_ == fire_stamp) {
+            // Wake up as late as all slacks allow, and all deadlines passed by then are
+            // expired in the same wakeup.
+            wakeup_stamp = std::min(wakeup_stamp, fire_stamp);
+            break;
+        }
+        fire_stamps_.pop();
+    }
+    return wakeup_stamp;
+}
+
+std::chrono::milliseconds EventHub::CalculateWaittingTime()
+{
+    using namespace std::chrono_literals;
+
+    if (!active_fds_.empty()) {
+        // Activated events are waitting for response.
+        return 0ms;
+    }
+    auto now = Now();
+    auto wakeup_stamp = CalculateWakeupStamp();
+    if (wakeup_stamp == std::chrono::time_point<std::chrono::system_clock>::max() || wakeup_stamp <= now) {
+        return 0ms;
     }
+    // Round up, otherwise the loop would spin until the last fraction is passed.
+    return std::chrono::ceil<std::chrono::milliseconds>(wakeup_stamp - now);
 }
 
-std::chrono::seconds EventHub::CalculateWaittingTime()
+void EventHub::CheckOverload(std::chrono::time_point<std::chrono::system_clock> intended_stamp)
 {
     using namespace std::chrono_literals;
 
-    if (timeout_heap_.Empty()) {
-        return 0s;
+    // The intended wakeup is in the past if the former iteration took too long, so the
+    // lag covers both the poll itself and callbacks before it.
+    auto now = Now();
+    loop_lag_ = now > intended_stamp ?
+        std::chrono::duration_cast<std::chrono::microseconds>(now - intended_stamp) : 0us;
+
+    auto level = OverloadLevel::kNone;
+    if (loop_lag_ >= overload_policy_->park_reads_lag) {
+        level = OverloadLevel::kParkingReads;
+    } else if (loop_lag_ >= overload_policy_->pause_accept_lag) {
+        level = OverloadLevel::kPausingAccept;
+    } else if (loop_lag_ >= overload_policy_->deprioritize_lag) {
+        level = OverloadLevel::kDeprioritizing;
+    }
+    if (level < overload_level_ && loop_lag_ >= overload_policy_->recovery_lag) {
+        // Not recovered yet.
+        return;
     }
-    const auto& current_ev = events.at(timeout_heap_.Top());
-    auto now = std::chrono::system_clock::now();
-    if (current_ev->timeout_stamp_ <= now) {
-        return 0s;
+    if (level == overload_level_) {
+        return;
+    }
+    // Parked events are resumed by ticks once the level goes down.
+    overload_level_ = level;
+#ifdef DEBUG
+    std::cout << std::format("[noevent] - overload level: {}, lag: {}\n", (int)level, loop_lag_);
+#endif
+    if (overload_cb_ != nullptr) {
+        overload_cb_(level, loop_lag_);
     }
-    return std::chrono::duration_cast<std::chrono::seconds>
-        (current_ev->timeout_stamp_ - now);
 }
 
 void EventHub::CheckTimeoutEvents()
 {
-    auto now = std::chrono::system_clock::now();
+    auto now = Now();
     while (!timeout_heap_.Empty()) {
-        const auto& current_ev = events.at(timeout_heap_.Top());
+        const auto& current_ev = FindEvent(timeout_heap_.Top());
         if (current_ev->timeout_stamp_ > now) {
             break;
         }
         timeout_heap_.Pop();
+        if (current_ev->is_timeout_stale) {
+            // The event was responsed and its timeout has not been re-armed since then.
+            current_ev->is_timeout_stale = false;
+            current_ev->where_.set((int)Event::Where::kInTimeout, false);
+            continue;
+        }
+        if (current_ev->deadline_stamp_ > now) {
+            // The event had been prolonged, re-insert it with the real deadline.
+            current_ev->timeout_stamp_ = current_ev->deadline_stamp_;
+            TimeoutPush(current_ev->fd_);
+            continue;
+        }
         current_ev->where_.set((int)Event::Where::kInTimeout, false);
 
-        if (IsInActive(current_ev->fd_)) {
+        if (current_ev->where_.test((int)Event::Where::kInActive)) {
             // The event is just active, not be responsed yet.
             current_ev->result_.reset().set((int)Event::Type::kTimeout, true);
 #ifdef DEBUG
@@ -312,10 +823,12 @@ void EventHub::CheckTimeoutEvents()
             continue;
         }
 
-        if (current_ev->read_cb_ != nullptr || current_ev->write_cb_ != nullptr) {
-            // If any of read/write callback(s) is not `nullptr`, then the event does have
-            // callback(s) since it had been locked and it is still not be activated.
-            sys_ev_op_->Del(current_ev->fd_);
+        // A throttled event may still be registered for its other direction.
+        if (current_ev->where_.test((int)Event::Where::kInThrottled)) {
+            ThrottledRemove(current_ev->fd_);
+        }
+        if (current_ev->where_.test((int)Event::Where::kInSystem)) {
+            SystemDel(current_ev);
         }
 
         // Now we can change states of the event safely.
@@ -328,48 +841,147 @@ void EventHub::CheckTimeoutEvents()
     }
 }
 
+void EventHub::CheckThrottledEvents()
+{
+    // Buckets are refilled on a coarse tick rather than timers of each event, since
+    // a few milliseconds of delay is acceptable for throttled events.
+    auto now = Now();
+    if (now - tick_stamp_ < tick_period_) {
+        return;
+    }
+    tick_stamp_ = now;
+
+    for (auto it = throttled_fds_.begin(); it != throttled_fds_.end(); ) {
+        const auto& current_ev = FindEvent(*it);
+        bool was_read_parked = current_ev->is_read_parked;
+        bool was_write_parked = current_ev->is_write_parked;
+        Park(current_ev);
+        if (current_ev->is_read_parked == was_read_parked && current_ev->is_write_parked == was_write_parked) {
+            ++it;
+            continue;
+        }
+        // Resumed events will be registered during the next preprocess, which parks
+        // them again if either direction is still empty.
+        it = throttled_fds_.erase(it);
+        current_ev->where_.set((int)Event::Where::kInThrottled, false);
+        ReadyPush(current_ev->fd_);
+#ifdef DEBUG
+    std::cout << std::format("[noevent] - event({}) resumed, READY: #{}, THROTTLED: #{}\n",
+        current_ev->fd_, ready_fds_.size(), throttled_fds_.size());
+#endif
+    }
+}
+
 void EventHub::ResponseActiveEvents()
 {
-    while (!active_fds_.empty()) {
-        const auto& current_ev = events.at(ActiveFrontAndPop());
+    // Events activated by callbacks are responsed in the next loop, so that they would
+    // not starve others.
+    for (auto count = active_fds_.size(); count > 0; --count) {
+        auto it = events.find(ActiveFrontAndPop());
+        if (it == events.end()) {
+            // It is destroyed by a former callback in this loop.
+            continue;
+        }
+        // Hold a copy since callbacks may destroy the event.
+        const auto current_ev = it->second;
 
-        if (current_ev->result_.test((int)Event::Type::kWrite) ||
-            current_ev->result_.test((int)Event::Type::kRead)) {
-            sys_ev_op_->Del(current_ev->fd_);
+        if (current_ev->where_.test((int)Event::Where::kInSystem)) {
+            SystemDel(current_ev);
+        }
+        if (current_ev->where_.test((int)Event::Where::kInThrottled)) {
+            // It was registered for the other direction, and responsing takes over.
+            ThrottledRemove(current_ev->fd_);
+        }
+        if (overload_level_ >= OverloadLevel::kDeprioritizing && !current_ev->is_deferred &&
+            current_ev->result_.test((int)Event::Type::kRead) &&
+            current_ev->read_cost_ > 4 * avg_read_cost_) {
+            // A heavy reader is put off to the next loop once, so it gets a lower share.
+            current_ev->is_deferred = true;
+            ActivePush(current_ev->fd_);
+            continue;
+        }
+        current_ev->is_deferred = false;
+        if (current_ev->result_.test((int)Event::Type::kRead) && current_ev->is_auto_read &&
+            current_ev->read_cb_ != nullptr && !FillReadBuffer(current_ev)) {
+            current_ev->result_.set((int)Event::Type::kRead, false);
+            if (current_ev->result_.none()) {
+                // Nothing to read actually, so it keeps its callbacks and timeout and
+                // will be registered again.
+                ReadyPush(current_ev->fd_);
+                continue;
+            }
+        }
+        if (current_ev->result_.test((int)Event::Type::kWrite) && !current_ev->outbox_.empty()) {
+            FlushOutbox(current_ev);
+            if (!current_ev->outbox_.empty() && !current_ev->where_.test((int)Event::Where::kInDirty)) {
+                // The rest waits for writability again once this loop is over.
+                DirtyPush(current_ev->fd_);
+            }
+        }
+        if (current_ev->result_.test((int)Event::Type::kWrite) &&
+            (current_ev->write_cb_ == nullptr || current_ev->is_write_parked) && current_ev->result_.count() == 1) {
+            // The event is woken up only by its pending output, so it keeps the callbacks
+            // and timeout and will be registered again if it has been armed.
+            current_ev->result_.reset();
+            if (current_ev->read_cb_ != nullptr || current_ev->write_cb_ != nullptr) {
+                ReadyPush(current_ev->fd_);
+            }
+            continue;
         }
         Event::Callback wr_callback = current_ev->write_cb_;
         Event::Callback rd_callbcak = current_ev->read_cb_;
         current_ev->read_cb_ = current_ev->write_cb_ = nullptr;
-        if (IsInTimeout(current_ev->fd_)) {
-            TimeoutRemove(current_ev->fd_);
+        if (current_ev->where_.test((int)Event::Where::kInTimeout)) {
+            // It is cheaper than removing the entry, and `Ready()` or `Touch()` in the
+            // callbacks only revives it.
+            current_ev->is_timeout_stale = true;
         }
 
+        // The result is taken before callbacks, which may activate the event again.
+        const auto result = current_ev->result_;
+        current_ev->result_.reset();
         current_ev->is_locked = false;
-        if (wr_callback != nullptr && current_ev->result_.test((int)Event::Type::kWrite)) {
+        current_ev->is_responsing = true;
+        if (wr_callback != nullptr && result.test((int)Event::Type::kWrite)) {
             wr_callback(current_ev->fd_, Event::Type::kWrite, current_ev->data_);
-            if (current_ev == nullptr) {
-                return;
+            if (current_ev->is_destroyed) {
+                continue;
             }
         }
-        if (rd_callbcak != nullptr && current_ev->result_.test((int)Event::Type::kRead)) {
-            rd_callbcak(current_ev->fd_, Event::Type::kRead, current_ev->data_);
-            if (current_ev == nullptr) {
-                return;
+        if (rd_callbcak != nullptr && result.test((int)Event::Type::kRead)) {
+            if (overload_policy_.has_value()) {
+                auto start_stamp = std::chrono::steady_clock::now();
+                rd_callbcak(current_ev->fd_, Event::Type::kRead, current_ev->data_);
+                auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start_stamp).count();
+                // Moving averages with a weight of 1/8 for the latest one.
+                current_ev->read_cost_ = (current_ev->read_cost_ * 7 + cost) / 8;
+                avg_read_cost_ = (avg_read_cost_ * 7 + cost) / 8;
+            } else {
+                rd_callbcak(current_ev->fd_, Event::Type::kRead, current_ev->data_);
+            }
+            // The buffer goes back to the pool unless it has been taken.
+            current_ev->read_buffer_ = utils::PooledBuffer {};
+            if (current_ev->is_destroyed) {
+                continue;
             }
         }
-        if (current_ev->result_.test((int)Event::Type::kError)) {
+        if (result.test((int)Event::Type::kError)) {
             current_ev->error_cb_(current_ev->fd_, Event::Type::kError, current_ev->data_);
-            if (current_ev == nullptr) {
-                return;
+            if (current_ev->is_destroyed) {
+                continue;
             }
         }
-        if (current_ev->result_.test((int)Event::Type::kTimeout)) {
+        if (result.test((int)Event::Type::kTimeout)) {
             current_ev->error_cb_(current_ev->fd_, Event::Type::kTimeout, current_ev->data_);
-            if (current_ev == nullptr) {
-                return;
+            if (current_ev->is_destroyed) {
+                continue;
             }
         }
-        current_ev->result_.reset();
+        current_ev->is_responsing = false;
+        // Callbacks may not re-arm the event, while its pending output was registered
+        // along with them and has just been dropped from the system.
+        KeepWritable(current_ev);
 #ifdef DEBUG
     std::cout << std::format("[noevent] - event({}) responsed, READY: #{}, TIMEOUT: #{}, ACTIVE: #{}\n",
         current_ev->fd_, ready_fds_.size(), timeout_heap_.Size(), active_fds_.size());
@@ -377,44 +989,318 @@ void EventHub::ResponseActiveEvents()
     }
 }
 
+void EventHub::TimeoutSchedule(int fd, std::chrono::time_point<std::chrono::system_clock> deadline)
+{
+    const auto& current_ev = FindEvent(fd);
+
+    current_ev->deadline_stamp_ = deadline;
+    if (current_ev->where_.test((int)Event::Where::kInTimeout)) {
+        current_ev->is_timeout_stale = false;
+        if (deadline >= current_ev->timeout_stamp_) {
+            // Only a later deadline is recorded here. The stale entry will be re-inserted
+            // lazily once it expires, so the heap is not touched for every prolonging.
+            return;
+        }
+        TimeoutRemove(fd);
+    }
+    current_ev->timeout_stamp_ = deadline;
+    TimeoutPush(fd);
+}
+
 void EventHub::TimeoutPush(int fd)
 {
+    const auto& current_ev = FindEvent(fd);
     timeout_heap_.Push(fd);
-    events.at(fd)->where_.set((int)Event::Where::kInTimeout, true);
+    current_ev->where_.set((int)Event::Where::kInTimeout, true);
+    current_ev->fire_stamp_ = current_ev->timeout_stamp_ + current_ev->timer_slack_.value_or(timer_slack_);
+    fire_stamps_.emplace(current_ev->fire_stamp_, fd);
 }
 
 void EventHub::TimeoutRemove(int fd)
 {
+    const auto& current_ev = FindEvent(fd);
     timeout_heap_.Remove(fd);
-    events.at(fd)->where_.set((int)Event::Where::kInTimeout, false);
+    current_ev->where_.set((int)Event::Where::kInTimeout, false);
+    current_ev->is_timeout_stale = false;
 }
 
 void EventHub::ReadyPush(int fd)
 {
     ready_fds_.push(fd);
-    events.at(fd)->where_.set((int)Event::Where::kInReady, true);
+    FindEvent(fd)->where_.set((int)Event::Where::kInReady, true);
 }
 
 int EventHub::ReadyFrontAndPop()
 {
     int fd = ready_fds_.front();
     ready_fds_.pop();
-    events.at(fd)->where_.set((int)Event::Where::kInReady, false);
+    FindEvent(fd)->where_.set((int)Event::Where::kInReady, false);
     return fd;
 }
 
+bool EventHub::Probe(const std::shared_ptr<Event>& ev)
+{
+    constexpr std::uint32_t kMaxProbeBackoff { 64 };
+
+    if (ev->probe_skips_ > 0) {
+        ev->probe_skips_--;
+        return false;
+    }
+
+    struct pollfd poll_fd { ev->fd_, 0, 0 };
+    if (ev->WantsWrite()) {
+        poll_fd.events |= POLLOUT;
+    }
+    if (ev->WantsRead()) {
+        poll_fd.events |= POLLIN;
+    }
+    // An invalid fd is left to `Add()`, which reports the error in the usual way.
+    if (poll(&poll_fd, 1, 0) == 1 && !(poll_fd.revents & POLLNVAL)) {
+        if (poll_fd.revents & (POLLIN | POLLHUP) && ev->WantsRead()) {
+            ev->result_.set((int)Event::Type::kRead, true);
+        }
+        if (poll_fd.revents & POLLOUT) {
+            ev->result_.set((int)Event::Type::kWrite, true);
+        }
+        if (ev->result_.none() && (poll_fd.revents & POLLERR)) {
+            socklen_t error_len = sizeof(ev->error_);
+            getsockopt(ev->fd_, SOL_SOCKET, SO_ERROR, &ev->error_, &error_len);
+            ev->result_.set((int)Event::Type::kError, true);
+        }
+        if (ev->result_.any()) {
+            ev->probe_hits_++;
+            ev->probe_backoff_ = 0;
+            return true;
+        }
+    }
+    ev->probe_misses_++;
+    ev->probe_backoff_ = std::min(std::max(ev->probe_backoff_ * 2, 1u), kMaxProbeBackoff);
+    ev->probe_skips_ = ev->probe_backoff_;
+    return false;
+}
+
+bool EventHub::FillReadBuffer(const std::shared_ptr<Event>& ev)
+{
+    auto read_buffer = buffer_pool_.Acquire(ev->read_class_);
+    ssize_t len;
+    do {
+        len = read(ev->fd_, read_buffer.Data(), read_buffer.Capacity());
+    } while (len < 0 && errno == EINTR);
+    if (len < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return false;
+        }
+        // It goes to the error callback instead, which is what a failed read means.
+        ev->error_ = errno;
+        ev->result_.set((int)Event::Type::kError, true);
+        return false;
+    }
+
+    // Grow the class if the buffer is filled up, and shrink it if the most is wasted.
+    if (static_cast<std::size_t>(len) == read_buffer.Capacity() &&
+        ev->read_class_ + 1 < utils::BufferPool::kClassCount) {
+        ev->read_class_++;
+    } else if (static_cast<std::size_t>(len) <= read_buffer.Capacity() / 4 && ev->read_class_ > 0) {
+        ev->read_class_--;
+    }
+    read_buffer.Resize(len);
+    ev->read_buffer_ = std::move(read_buffer);
+    return true;
+}
+
+void EventHub::SystemDel(const std::shared_ptr<Event>& ev)
+{
+    // A failure is ignored since the kernel drops closed fds by itself.
+    BackendDel(ev->fd_);
+    ev->where_.set((int)Event::Where::kInSystem, false);
+}
+
 void EventHub::ActivePush(int fd)
 {
     active_fds_.push(fd);
-    events.at(fd)->where_.set((int)Event::Where::kInActive, true);
+    FindEvent(fd)->where_.set((int)Event::Where::kInActive, true);
 }
 
 int EventHub::ActiveFrontAndPop()
 {
     int fd = active_fds_.front();
     active_fds_.pop();
-    events.at(fd)->where_.set((int)Event::Where::kInActive, false);
+    if (auto it = events.find(fd); it != events.end()) {
+        it->second->where_.set((int)Event::Where::kInActive, false);
+    }
     return fd;
 }
 
+void EventHub::FlushDirtyEvents()
+{
+    std::vector<int> dirty_fds;
+    dirty_fds.swap(dirty_fds_);
+
+    for (int fd : dirty_fds) {
+        const auto& current_ev = FindEvent(fd);
+        current_ev->where_.set((int)Event::Where::kInDirty, false);
+        if (FlushOutbox(current_ev) && !current_ev->outbox_.empty()) {
+            // The kernel buffer is full.
+            WaitWritable(current_ev);
+        }
+#ifdef DEBUG
+    std::cout << std::format("[noevent] - event({}) flushed, PENDING: #{}, DIRTY: #{}\n",
+        current_ev->fd_, current_ev->outbox_.size(), dirty_fds_.size());
+#endif
+    }
+}
+
+bool EventHub::Park(const std::shared_ptr<Event>& ev)
+{
+    auto is_empty = [this](const std::shared_ptr<utils::TokenBucket>& bucket) -> bool {
+        if (bucket == nullptr) {
+            return false;
+        }
+        bucket->Refill(tick_stamp_);
+        return bucket->Empty();
+    };
+
+    // Reads parked by overload control are resumed by ticks, as throttled ones.
+    ev->is_read_parked = ev->read_cb_ != nullptr &&
+        (overload_level_ >= OverloadLevel::kParkingReads ||
+        (overload_level_ >= OverloadLevel::kPausingAccept && ev->is_listener) ||
+        is_empty(ev->read_limits_[0]) || is_empty(ev->read_limits_[1]));
+    ev->is_write_parked = ev->write_cb_ != nullptr &&
+        (is_empty(ev->write_limits_[0]) || is_empty(ev->write_limits_[1]));
+    return ev->is_read_parked || ev->is_write_parked;
+}
+
+void EventHub::ThrottledPush(int fd)
+{
+    throttled_fds_.push_back(fd);
+    FindEvent(fd)->where_.set((int)Event::Where::kInThrottled, true);
+}
+
+void EventHub::ThrottledRemove(int fd)
+{
+    const auto& current_ev = FindEvent(fd);
+    throttled_fds_.remove(fd);
+    current_ev->where_.set((int)Event::Where::kInThrottled, false);
+    current_ev->is_read_parked = current_ev->is_write_parked = false;
+}
+
+void EventHub::SealStaging(const std::shared_ptr<Event>& ev)
+{
+    if (!ev->staging_.empty()) {
+        ev->outbox_.push_back(std::make_shared<const std::string>(std::move(ev->staging_)));
+        ev->staging_.clear();
+    }
+}
+
+bool EventHub::FlushOutbox(const std::shared_ptr<Event>& ev)
+{
+    constexpr int kMaxIovecs { 64 };
+#ifdef MSG_NOSIGNAL
+    // A closed peer fails the flush with `EPIPE` rather than killing the process.
+    constexpr int kSendFlags { MSG_NOSIGNAL };
+#else
+    constexpr int kSendFlags { 0 };
+#endif
+
+    SealStaging(ev);
+    while (!ev->outbox_.empty()) {
+        struct iovec iovs[kMaxIovecs];
+        int iov_count = 0;
+        for (const auto& payload : ev->outbox_) {
+            if (iov_count == kMaxIovecs) {
+                break;
+            }
+            std::size_t offset = iov_count == 0 ? ev->outbox_offset_ : 0;
+            iovs[iov_count].iov_base = const_cast<char*>(payload->data() + offset);
+            iovs[iov_count].iov_len = payload->size() - offset;
+            iov_count++;
+        }
+
+        ssize_t written;
+        if (ev->is_socket) {
+            struct msghdr msg {};
+            msg.msg_iov = iovs;
+            msg.msg_iovlen = iov_count;
+            written = sendmsg(ev->fd_, &msg, kSendFlags);
+            if (written < 0 && errno == ENOTSOCK) {
+                ev->is_socket = false;
+                continue;
+            }
+        } else {
+            written = writev(ev->fd_, iovs, iov_count);
+        }
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            // The connection is broken, users will know it by their own read or write.
+            ev->outbox_.clear();
+            ev->outbox_offset_ = 0;
+            return false;
+        }
+
+        std::size_t remaining = written;
+        while (remaining > 0) {
+            std::size_t front_left = ev->outbox_.front()->size() - ev->outbox_offset_;
+            if (remaining < front_left) {
+                ev->outbox_offset_ += remaining;
+                break;
+            }
+            remaining -= front_left;
+            ev->outbox_.pop_front();
+            ev->outbox_offset_ = 0;
+        }
+    }
+    return true;
+}
+
+void EventHub::WaitWritable(const std::shared_ptr<Event>& ev)
+{
+    if (ev->where_.test((int)Event::Where::kInReady)) {
+        // The next preprocess registers it along with its pending output.
+        return;
+    }
+    if (ev->where_.test((int)Event::Where::kInActive)) {
+        // It is retried at the end of the next loop, which is not going to block since
+        // the event is active.
+        DirtyPush(ev->fd_);
+        return;
+    }
+    // A registered event waits for writability as well, and an idle or throttled one is
+    // registered for its pending output besides directions not parked.
+    int error = ev->where_.test((int)Event::Where::kInSystem) ?
+        BackendMod(ev->fd_) : BackendAdd(ev->fd_);
+    if (error != 0) {
+        // The next flush fails as well and drops the output.
+        DirtyPush(ev->fd_);
+        return;
+    }
+    ev->where_.set((int)Event::Where::kInSystem, true);
+}
+
+void EventHub::KeepWritable(const std::shared_ptr<Event>& ev)
+{
+    if (ev->outbox_.empty() || ev->where_.test((int)Event::Where::kInDirty) ||
+        ev->where_.test((int)Event::Where::kInReady) || ev->where_.test((int)Event::Where::kInSystem)) {
+        // Nothing is pending, or it is going to be flushed or waits for writability.
+        return;
+    }
+    WaitWritable(ev);
+}
+
+void EventHub::DirtyPush(int fd)
+{
+    dirty_fds_.push_back(fd);
+    FindEvent(fd)->where_.set((int)Event::Where::kInDirty, true);
+}
+
+void EventHub::DirtyRemove(int fd)
+{
+    std::erase(dirty_fds_, fd);
+    FindEvent(fd)->where_.set((int)Event::Where::kInDirty, false);
+}
+
 }  // namespace noevent